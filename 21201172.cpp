@@ -6,10 +6,30 @@
 // dxball_simple.cpp
 // A simplified DX-Ball clone with a text-based menu.
 // Uses FreeGLUT + OpenGL. No external image files are required.
-// Build (MinGW): g++ dxball_simple.cpp -o dxball_simple.exe -lfreeglut -lopengl32 -lglu32 -lwinmm -std=c++11 -mconsole
+// Build (MinGW): g++ dxball_simple.cpp -o dxball_simple.exe -lfreeglut -lopengl32 -lglu32 -lwinmm -lws2_32 -std=c++11 -mconsole
+// Spectating: run with --publish, then watch from a second process with --spectate.
+// Telemetry: run with --telemetry, then sample from another process with --telemetry-read [ms].
+// Metrics: --metrics <file.prom> flushes Prometheus counters to a textfile every 15 s.
+// Hitches: frames slower than --hitch-ms (default 50) dump hitch-<frame>.csv/.world.
+// Profiling: --perf prints per-phase counters on exit; --bench includes a profiled pass.
+// Allocations: --alloc-check [ticks] [--windowed] fails if a steady-state frame allocates (--windowed also renders).
+// Quality: adapts tessellation and playfield resolution to load; --quality N pins a level (0 = best).
+// Memory: F3 shows per-subsystem bytes against budgets (--mem-budget rewind=256,...).
+// Replays: --record <file> saves the session; --regress replays checks the corpus in replays/.
+// Planner: --plan <seed> [ticks] [--plan-ms N|--plan-iters N] validates levels with MCTS; --mcts-pilot [ms] plays live.
+// Rendering: GL 3.3 draws the playfield as instanced SDF shapes; --legacy-gl keeps fixed function.
+// Ghost: --ghost <file> races your best run on its seed; beating it replaces the file.
+// Mosaic: --mosaic [16-64] [replay.dxr|list.txt]... shows many bot or replay games in one window.
+// Savegame: play is saved to savegame.dxs on pause, ESC, exit and every 5 s, and resumed at startup (--fresh skips it).
+// Analytics: --analytics <file.dxa> logs gameplay events; --analyze <log.dxa|list.txt>... [--out prefix] aggregates them.
+// Leaderboard: --verify <replay.dxr|list.txt>... [--out verified.txt] re-simulates submissions in parallel.
+// Stress: --stress [perks|projectiles|balls|bricks|fireball|massive] [--windowed] [--sim-threads N]
 
 #define _USE_MATH_DEFINES
+#include <winsock2.h>
+#include <afunix.h>
 #include <GL/glut.h>
+#include <GL/glext.h>
 #include <cmath>
 #include <vector>
 #include <string>
@@ -20,9 +40,23 @@
 #include <fstream>
 #include <algorithm>
 #include <iostream>
+#include <new>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <future>
+#include <chrono>
+#include <cstring>
+#include <cctype>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <windows.h>
 #include <mmsystem.h>
 #pragma comment(lib, "winmm.lib")
+#pragma comment(lib, "ws2_32.lib")
 
 // =======================================================
 // Part 2: Window & Global Constants
@@ -42,7 +76,6 @@ const int MAX_RECENT = 5;
 enum GameState { GS_MENU, GS_PLAYING, GS_PAUSED, GS_LEVEL_CLEAR, GS_GAMEOVER, GS_HELP, GS_SCOREBOARD, GS_MUSIC_MENU };
 
 GameState gameState = GS_MENU;
-int currentLevel = 1;
 
 // Entities
 struct Ball {
@@ -50,63 +83,590 @@ struct Ball {
     bool stuck;
     bool isFireball;
     float fireballTimer;
-} ball;
-struct Paddle { float x,y,w,h,speed; } paddle;
-struct Brick { float x,y,w,h; int hits; bool alive; int type; };
+};
+struct Paddle { float x,y,w,h,speed; };
 struct Perk { float x,y,vy; int type; bool alive; };
 struct Projectile { float x, y, vy; bool alive; };
 
-std::vector<Brick> bricks;
-std::vector<Perk> perks;
-std::vector<Projectile> projectiles;
+// Memory accounting: each subsystem allocates through an allocator tagged
+// with its MemTag, which tracks current and peak bytes against a budget
+// (bytes, 0 = none; --mem-budget overrides). Going over budget warns once.
+enum MemTag { MEM_BRICKS, MEM_PERKS, MEM_PROJECTILES, MEM_REWIND, MEM_SPECTATORS, MEM_REPLAYS, MEM_SCORES, MEM_TEXT, MEM_SAVES, MEM_TAGS };
 
-// Gameplay state
-int score = 0;
-int lives = 3;
+const char* MEM_TAG_NAMES[MEM_TAGS] = { "bricks", "perks", "projectiles", "rewind", "spectators", "replays", "scores", "text", "saves" };
+
+int64_t memBudget[MEM_TAGS] = {
+    16 * 1024,      // bricks: 8 rows of 10, columns cache-line aligned
+    4 * 1024,       // perks
+    4 * 1024,       // projectiles
+    640 * 1024,     // rewind: 30 s ring of deltas plus keyframes
+    512 * 1024,     // spectators: image and backlog per viewer
+    1024 * 1024,    // replays: about an hour of recorded input
+    1024,           // scores
+    16 * 1024,      // text: the frame arena
+    32 * 1024,      // saves: pending image, file framing, pause image
+};
+
+struct MemAccount {
+    std::atomic<int64_t> current, peak;
+    std::atomic<bool> warned;
+} memAccounts[MEM_TAGS];
+
+bool profilerOverlay = false; // F3
+
+void memCharge(int tag, int64_t bytes) {
+    MemAccount &a = memAccounts[tag];
+    int64_t now = a.current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = a.peak.load(std::memory_order_relaxed);
+    while (now > peak && !a.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    if (memBudget[tag] > 0 && now > memBudget[tag] && !a.warned.exchange(true))
+        fprintf(stderr, "memory: %s over budget (%lld of %lld bytes)\n", MEM_TAG_NAMES[tag], (long long)now, (long long)memBudget[tag]);
+}
+
+template <typename T, int Tag>
+struct TaggedAllocator {
+    typedef T value_type;
+    template <typename U> struct rebind { typedef TaggedAllocator<U, Tag> other; };
+    TaggedAllocator() {}
+    template <typename U> TaggedAllocator(const TaggedAllocator<U, Tag>&) {}
+    T* allocate(size_t n) {
+        T* p = (T*)::operator new(n * sizeof(T));
+        memCharge(Tag, (int64_t)(n * sizeof(T)));
+        return p;
+    }
+    void deallocate(T* p, size_t n) {
+        memCharge(Tag, -(int64_t)(n * sizeof(T)));
+        ::operator delete(p);
+    }
+};
+template <typename T, typename U, int Tag> bool operator==(const TaggedAllocator<T, Tag>&, const TaggedAllocator<U, Tag>&) { return true; }
+template <typename T, typename U, int Tag> bool operator!=(const TaggedAllocator<T, Tag>&, const TaggedAllocator<U, Tag>&) { return false; }
+
+template <typename T, int Tag> using TaggedVec = std::vector<T, TaggedAllocator<T, Tag> >;
+
+// Bricks are stored column-wise: the hot column (alive/hits/type, 4 bytes per
+// brick) is what every scan touches, the cold geometry columns are only read
+// for bricks that are still alive. Each column starts on its own cache line.
+const size_t CACHE_LINE = 64;
+
+template <typename T, int Tag = MEM_BRICKS>
+struct CacheAlignedAllocator {
+    typedef T value_type;
+    template <typename U> struct rebind { typedef CacheAlignedAllocator<U, Tag> other; };
+    CacheAlignedAllocator() {}
+    template <typename U> CacheAlignedAllocator(const CacheAlignedAllocator<U, Tag>&) {}
+    T* allocate(size_t n) {
+        void* raw = malloc(n * sizeof(T) + CACHE_LINE + sizeof(void*));
+        if (!raw) throw std::bad_alloc();
+        memCharge(Tag, (int64_t)(n * sizeof(T) + CACHE_LINE + sizeof(void*)));
+        uintptr_t p = ((uintptr_t)raw + sizeof(void*) + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+        ((void**)p)[-1] = raw;
+        return (T*)p;
+    }
+    void deallocate(T* p, size_t n) {
+        memCharge(Tag, -(int64_t)(n * sizeof(T) + CACHE_LINE + sizeof(void*)));
+        free(((void**)p)[-1]);
+    }
+};
+template <typename T, typename U, int Tag> bool operator==(const CacheAlignedAllocator<T, Tag>&, const CacheAlignedAllocator<U, Tag>&) { return true; }
+template <typename T, typename U, int Tag> bool operator!=(const CacheAlignedAllocator<T, Tag>&, const CacheAlignedAllocator<U, Tag>&) { return false; }
+
+template <typename T> using AlignedVec = std::vector<T, CacheAlignedAllocator<T> >;
+
+struct BrickHot { unsigned char alive, hits, type, pad; };
+
+// A row-major lattice of same-sized bricks: brick i sits at column i % cols,
+// row i / cols, with its lower-left corner at (x + c*pitchX, y - r*pitchY).
+// cols == 0 when the layout is not a lattice.
+struct BrickGrid {
+    int cols = 0, rows = 0;
+    float x = 0, y = 0, pitchX = 0, pitchY = 0, w = 0, h = 0;
+};
+
+const int BRICK_TEXEL_UPDATES = 32; // Above this many changes, whole rows are sent
+
+// Which hot entries changed since the brick-field texture last caught up.
+// Render bookkeeping rather than world state, so it is never serialized and
+// the renderer may drain it through a const store. Past BRICK_TEXEL_UPDATES
+// changes only the index range is kept.
+struct BrickDirty {
+    int index[BRICK_TEXEL_UPDATES];
+    int count = 0, lo = 0, hi = -1;
+    bool all = true;                 // The whole column must be re-sent
+    void add(int i) {
+        if (all) return;
+        if (count < BRICK_TEXEL_UPDATES) index[count] = i;
+        count++;
+        lo = count == 1 ? i : std::min(lo, i);
+        hi = std::max(hi, i);
+    }
+    void reset(bool whole) { count = 0; lo = 0; hi = -1; all = whole; }
+};
+
+struct BrickStore {
+    AlignedVec<BrickHot> hot;        // Hot column
+    AlignedVec<float> x, y, w, h;    // Cold geometry columns
+    AlignedVec<int> live;            // Indices of alive bricks, in creation order
+    bool liveDirty = false;          // A brick died since the last compact()
+    BrickGrid grid;                  // Set by fitGrid() once the layout is complete
+    mutable BrickDirty dirty;        // Changed since the texture last synced
+
+    int size() const { return (int)hot.size(); }
+    void clear() { hot.clear(); x.clear(); y.clear(); w.clear(); h.clear(); live.clear(); liveDirty = false; grid = BrickGrid(); dirty.reset(true); }
+    void add(float bx, float by, float bw, float bh, int hits, int type) {
+        BrickHot hb; hb.alive = 1; hb.hits = (unsigned char)hits; hb.type = (unsigned char)type; hb.pad = 0;
+        live.push_back(size());
+        hot.push_back(hb);
+        x.push_back(bx); y.push_back(by); w.push_back(bw); h.push_back(bh);
+    }
+    void kill(int i) { hot[i].alive = 0; liveDirty = true; dirty.add(i); }
+    void damage(int i) { hot[i].hits--; dirty.add(i); }
+    // Drops dead bricks out of the live range, keeping creation order so
+    // collision resolution stays the same as a full scan.
+    void compact() {
+        if (!liveDirty) return;
+        const BrickHot* hp = hot.data();
+        live.erase(std::remove_if(live.begin(), live.end(), [hp](int i) { return !hp[i].alive; }), live.end());
+        liveDirty = false;
+    }
+    // Recognises a lattice layout so the renderer can draw the field from
+    // one texel per brick. Geometry never changes after a level is built.
+    void fitGrid() {
+        grid = BrickGrid();
+        int n = size(), cols = 1;
+        if (n == 0) return;
+        while (cols < n && y[cols] == y[0]) ++cols;
+        if (n % cols != 0) return;
+        float px = cols > 1 ? x[1] - x[0] : w[0];
+        float py = n > cols ? y[0] - y[cols] : h[0];
+        if (px < w[0] || fabsf(py) < h[0]) return;
+        for (int i = 0; i < n; ++i) {
+            int r = i / cols, c = i % cols;
+            if (fabsf(x[i] - (x[0] + c * px)) > 0.01f || fabsf(y[i] - (y[0] - r * py)) > 0.01f) return;
+            if (w[i] != w[0] || h[i] != h[0]) return;
+        }
+        grid.cols = cols; grid.rows = n / cols;
+        grid.x = x[0]; grid.y = y[0]; grid.pitchX = px; grid.pitchY = py;
+        grid.w = w[0]; grid.h = h[0];
+    }
+};
+
+// Small self-contained generator. Each world owns one, so its sequence is
+// part of the world state and level layouts can be built off the game thread.
+struct Rng {
+    uint32_t s;
+    explicit Rng(uint32_t seed = 1) : s(seed ? seed : 1) {}
+    uint32_t next() { s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s; }
+    int range(int n) { return (int)(next() % (uint32_t)n); }
+    float unit() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+// Player input for one tick. Held keys are levels; launch, fire and mouse
+// moves are edges that the timer clears once a tick has consumed them.
+struct InputFrame {
+    bool left, right;
+    bool launch, fire;
+    bool mouseMoved;
+    float mouseX;
+};
+
+// Set by the simulation when a world stops playing; the caller decides what
+// screen that leads to.
+enum WorldOutcome { WO_NONE, WO_LEVEL_CLEAR, WO_GAME_OVER };
+
+// Running tallies kept by the simulation for telemetry. Monotonic, and not
+// part of the snapshot image.
+struct WorldCounters {
+    uint32_t wallHits, paddleHits, brickHits, perksCaught;
+};
+
+// Level scripts are resumable functions: each task records where its script
+// left off (pc) and what it is waiting for, and the world's scheduler resumes
+// it only when one of those fires. The scheduler keeps the earliest deadline,
+// the highest brick threshold and the union of awaited events, so a waiting
+// level is checked against three cached values instead of running its scripts.
+enum ScriptEvent { SEV_FIREBALL, SEV_COUNT };
+
+const int MAX_LEVEL_SCRIPTS = 4;
+const uint8_t SCRIPT_DONE = 255;
+
+struct ScriptTask {
+    uint8_t script;          // LevelScript id
+    uint8_t pc;              // Resume point, or SCRIPT_DONE
+    uint8_t waitEvents;      // ScriptEvent bits that resume the task
+    float wakeAt;            // Scheduler clock deadline, or infinity
+    int32_t wakeBricks;      // Resume once bricksRemaining <= this, or -1
+};
+
+struct ScriptScheduler {
+    ScriptTask tasks[MAX_LEVEL_SCRIPTS];
+    int count = 0;           // 0 when the level is unscripted
+    float clock = 0.0f;      // Seconds of play since the scripts started
+    float nextWake = INFINITY;
+    int32_t wakeBricks = -1;
+    uint8_t waitEvents = 0, signals = 0;
+    uint8_t palette = 0;     // 1 while a script has swapped the brick colours
+    void signal(int ev) { signals |= (uint8_t)(1u << ev) & waitEvents; }
+};
+
+// Everything the simulation reads and writes. The live game runs on 'world';
+// other copies can be stepped, snapshotted or restored independently.
+struct World {
+    Ball ball;
+    Paddle paddle;
+    BrickStore bricks;
+    TaggedVec<Perk, MEM_PERKS> perks;
+    TaggedVec<Projectile, MEM_PROJECTILES> projectiles;
+    int score = 0;
+    int lives = 3;
+    int currentLevel = 1;
+    int bricksRemaining = 0;
+    float fireCooldown = 0.0f;
+    Rng rng;
+    WorldOutcome outcome = WO_NONE;
+    WorldCounters counters = {};
+    ScriptScheduler scripts;
+};
+
+World world;
+
+// Silver marks two-hit bricks, unless a level script swapped the palette.
+inline bool brickLooksTough(const World &w, const BrickHot &b) { return (b.hits == 2) != (w.scripts.palette != 0); }
+
+// Perk and projectile capacity reserved per world, above what normal play
+// reaches, so spawning never reallocates mid-level.
+const size_t PERK_CAPACITY = 64;
+const size_t PROJECTILE_CAPACITY = 128;
+
+// Drops dead entries in place, keeping the live ones in order.
+template <typename Vec> void compactDead(Vec &v) {
+    typedef typename Vec::value_type T;
+    v.erase(std::remove_if(v.begin(), v.end(), [](const T &e) { return !e.alive; }), v.end());
+}
+
+// A level generated ahead of time by the prefetch worker.
+struct PreparedLevel {
+    int level;
+    BrickStore bricks;
+    int count;
+};
+
+// Session state
 int highScore = 0;
-int bricksRemaining = 0;
 double gameStartTime = 0.0;
 double elapsedTime = 0.0;
-float fireCooldown = 0.0f;
-const float FIRE_RATE = 0.3f;
+constexpr float FIRE_RATE = 0.3f;
+
+constexpr float PERK_DROP_PROB = 0.25f;
+constexpr float BALL_SPEED_MAX = 900.0f;
+constexpr float BALL_SPEED_INCREASE_RATE = 5.0f;
+constexpr float PADDLE_W_MIN = 40.0f;
+constexpr float PADDLE_W_MAX = 280.0f;
+
+// Rule sets. Each preset is a type whose members are compile-time constants,
+// so updateGame<Rules> is constant-folded per preset. RuntimeRules reads the
+// same values from a table and exists as the branchy baseline for --bench.
+struct ClassicRules {
+    static constexpr float fireRate() { return FIRE_RATE; }
+    static constexpr float perkDropProb() { return PERK_DROP_PROB; }
+    static constexpr float ballSpeedMax() { return BALL_SPEED_MAX; }
+    static constexpr float ballSpeedIncreaseRate() { return BALL_SPEED_INCREASE_RATE; }
+    static constexpr float paddleWMin() { return PADDLE_W_MIN; }
+    static constexpr float paddleWMax() { return PADDLE_W_MAX; }
+    static constexpr bool loseLives() { return true; }   // Missing the ball costs a life
+    static constexpr bool endless() { return false; }    // Cleared field refills in place
+};
+struct HardRules : ClassicRules {
+    static constexpr float fireRate() { return 0.45f; }
+    static constexpr float perkDropProb() { return 0.18f; }
+    static constexpr float ballSpeedMax() { return 1100.0f; }
+    static constexpr float ballSpeedIncreaseRate() { return 9.0f; }
+    static constexpr float paddleWMax() { return 220.0f; }
+};
+struct EndlessRules : ClassicRules {
+    static constexpr bool endless() { return true; }
+};
+struct TrainingRules : ClassicRules {
+    static constexpr float perkDropProb() { return 0.40f; }
+    static constexpr float ballSpeedIncreaseRate() { return 0.0f; }
+    static constexpr bool loseLives() { return false; }
+};
+
+enum RuleSet { RULES_CLASSIC, RULES_HARD, RULES_ENDLESS, RULES_TRAINING, RULES_COUNT };
+
+struct RuleParams {
+    const char* name;
+    float fireRate, perkDropProb, ballSpeedMax, ballSpeedIncreaseRate, paddleWMin, paddleWMax;
+    bool loseLives, endless;
+};
+
+template <typename R> RuleParams makeRuleParams(const char* name) {
+    RuleParams rp = { name, R::fireRate(), R::perkDropProb(), R::ballSpeedMax(), R::ballSpeedIncreaseRate(),
+                      R::paddleWMin(), R::paddleWMax(), R::loseLives(), R::endless() };
+    return rp;
+}
+
+const RuleParams RULE_PARAMS[RULES_COUNT] = {
+    makeRuleParams<ClassicRules>("Classic"),
+    makeRuleParams<HardRules>("Hard"),
+    makeRuleParams<EndlessRules>("Endless"),
+    makeRuleParams<TrainingRules>("Training"),
+};
 
-const float PERK_DROP_PROB = 0.25f;
-const float BALL_SPEED_MAX = 900.0f;
-const float BALL_SPEED_INCREASE_RATE = 5.0f;
+RuleSet activeRuleSet = RULES_CLASSIC;
+const RuleParams* activeRules = &RULE_PARAMS[RULES_CLASSIC];
 
-// Input flags
-bool keyLeft=false, keyRight=false;
+struct RuntimeRules {
+    static float fireRate() { return activeRules->fireRate; }
+    static float perkDropProb() { return activeRules->perkDropProb; }
+    static float ballSpeedMax() { return activeRules->ballSpeedMax; }
+    static float ballSpeedIncreaseRate() { return activeRules->ballSpeedIncreaseRate; }
+    static float paddleWMin() { return activeRules->paddleWMin; }
+    static float paddleWMax() { return activeRules->paddleWMax; }
+    static bool loseLives() { return activeRules->loseLives; }
+    static bool endless() { return activeRules->endless; }
+};
+
+typedef void (*UpdateFn)(World&, const InputFrame&, double);
+
+// Input gathered by the GLUT callbacks for the next tick
+InputFrame input = {};
 bool musicPlaying=false;
 
+// Set by --bench: no window, no score files.
+bool headless = false;
+
+// Gameplay and health counters for the Prometheus textfile. Each thread adds
+// into its own cache-line-aligned shard, so gameplay code never contends; the
+// exporter thread sums the shards when it flushes.
+const int PERK_TYPES = 6;
+const char* const PERK_NAMES[PERK_TYPES] = { "life", "wide", "speed", "fireball", "shrink", "death" };
+const int FRAME_BUCKETS = 7;  // Bounds in FRAME_MS_BUCKETS, plus +Inf
+
+enum MetricId {
+    M_BRICKS_DESTROYED, M_BALLS_LOST, M_PROJECTILES_FIRED, M_DISK_WRITES,
+    M_PERK_SPAWNED_0, M_PERK_CAUGHT_0 = M_PERK_SPAWNED_0 + PERK_TYPES,
+    M_FRAME_BUCKET_0 = M_PERK_CAUGHT_0 + PERK_TYPES,
+    M_FRAME_COUNT = M_FRAME_BUCKET_0 + FRAME_BUCKETS + 1, M_FRAME_SUM_US,
+    METRIC_COUNT
+};
+
+const int METRIC_SHARDS = 16;
+
+struct alignas(64) MetricShard {
+    std::atomic<uint64_t> v[METRIC_COUNT];
+};
+
+MetricShard metricShards[METRIC_SHARDS];
+std::atomic<int> metricNextShard(0);
+
+// Set on a thread while it steps throwaway world copies (planner rollouts):
+// metrics, per-phase counters and intra-world stripes are skipped there.
+thread_local bool quietSim = false;
+
+inline void metricAdd(int id, uint64_t n = 1) {
+    if (quietSim) return;
+    static thread_local int shard = metricNextShard.fetch_add(1) % METRIC_SHARDS;
+    metricShards[shard].v[id].fetch_add(n, std::memory_order_relaxed);
+}
+
+// Session analytics events (--analytics). Only the live world is logged;
+// see logSessionEvent.
+enum SessionEventType {
+    SE_GAME_START, SE_LEVEL_START, SE_PADDLE_HIT, SE_BRICK_HIT, SE_BRICK_KILL,
+    SE_PERK_SPAWN, SE_PERK_CATCH, SE_PERK_MISS, SE_BALL_LOST, SE_GAME_OVER,
+    SE_TYPE_COUNT
+};
+
+// Per-phase hardware counters (--perf, and the profiled pass of --bench).
+// Windows gives user mode no PMU access, so the only counter that can be
+// read is the thread's cycle count (QueryThreadCycleTime); instructions and
+// cache/branch misses are reported as unavailable. Off by default, so a
+// disabled phase scope costs one predictable branch.
+enum PerfPhase {
+    PH_INPUT, PH_MOVE, PH_WALLS, PH_PADDLE, PH_BRICKS, PH_PERKS, PH_PROJECTILES, PH_COMPACT, PH_SPEED,
+    PH_RENDER_BRICKS, PH_RENDER_PERKS, PH_RENDER_PROJECTILES, PH_RENDER_HUD,
+    PHASE_COUNT
+};
+enum PerfCounter { PC_CYCLES, PC_INSTRUCTIONS, PC_L1_MISSES, PC_LLC_MISSES, PC_BRANCH_MISSES, PERF_COUNTERS };
+
+struct PerfPhaseStats {
+    uint64_t calls;
+    double ns;
+    uint64_t counters[PERF_COUNTERS];
+};
+
+bool perfEnabled = false;
+bool perfAvailable[PERF_COUNTERS] = {};
+PerfPhaseStats perfStats[PHASE_COUNT];
+
+inline void readPerfCounters(uint64_t out[PERF_COUNTERS]) {
+    ULONG64 cycles = 0;
+    QueryThreadCycleTime(GetCurrentThread(), &cycles);
+    out[PC_CYCLES] = cycles;
+}
+
+struct PerfScope {
+    PerfPhase phase;
+    uint64_t start[PERF_COUNTERS];
+    std::chrono::steady_clock::time_point t0;
+    explicit PerfScope(PerfPhase ph) : phase(ph) {
+        if (!perfEnabled || quietSim) return;
+        t0 = std::chrono::steady_clock::now();
+        readPerfCounters(start);
+    }
+    ~PerfScope() {
+        if (!perfEnabled || quietSim) return;
+        uint64_t end[PERF_COUNTERS];
+        readPerfCounters(end);
+        PerfPhaseStats &st = perfStats[phase];
+        st.calls++;
+        st.ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        for (int c = 0; c < PERF_COUNTERS; ++c) if (perfAvailable[c]) st.counters[c] += end[c] - start[c];
+    }
+};
+
+// Heap allocations made by the calling thread. The global operator new below
+// counts them, so a steady-state frame can be checked for allocating at all.
+thread_local uint64_t threadAllocs = 0;
+
+// Counting interposer for the global heap.
+void* operator new(size_t n) {
+    threadAllocs++;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t n) { return operator new(n); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { threadAllocs++; return malloc(n ? n : 1); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { threadAllocs++; return malloc(n ? n : 1); }
+// Kept out of line so GCC does not pair the inlined free() with new.
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void* p) noexcept { free(p); }
+
+// Transient storage for one rendered frame (HUD text and the like). It is
+// reset at the start of renderScene, so nothing in it outlives the frame.
+struct FrameArena {
+    alignas(16) char buf[16 * 1024];
+    size_t used = 0;
+    void* alloc(size_t n) {
+        n = (n + 15) & ~(size_t)15;
+        if (used + n > sizeof(buf)) return nullptr;
+        void* p = buf + used;
+        used += n;
+        memCharge(MEM_TEXT, (int64_t)n);
+        return p;
+    }
+    void reset() { memCharge(MEM_TEXT, -(int64_t)used); used = 0; }
+} frameArena;
+
+// printf into the frame arena; the text is valid until the next frame.
+const char* frameText(const char* fmt, ...) {
+    char tmp[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) return "";
+    size_t len = std::min((size_t)n, sizeof(tmp) - 1);
+    char* out = (char*)frameArena.alloc(len + 1);
+    if (!out) return "";
+    memcpy(out, tmp, len + 1);
+    return out;
+}
+
 // =======================================================
 // Part 4: Forward Declarations
 // Details: Prototypes for functions defined later.
 // =======================================================
 
+void drawText(float x, float y, const char* s, void* font = GLUT_BITMAP_HELVETICA_18);
 void drawText(float x, float y, const std::string &s);
 void drawRect(float x, float y, float w, float h);
-void resetPaddleAndBall();
-void createBricksForLevel(int level);
+void resetPaddleAndBall(World &w);
+void createBricksForLevel(World &w, int level);
+void attachLevelScripts(World &w);
+void generateLevel(int level, uint32_t seed, float perkDropProb, BrickStore &out, int &count);
+void prefetchLevel(int level);
+void resetWorld(World &w, uint32_t seed);
+void beginLevel(World &w, int level);
 void startNewGame();
 void startLevel(int level);
 void openHelpFile();
+void probeMusic();
 void playMusic();
 void stopMusic();
+void setMusicFast(bool fast);
 int loadHighScore();
 void saveHighScore(int newScore);
 void saveScore(int s);
-std::vector<int> loadRecentScores();
+typedef TaggedVec<int, MEM_SCORES> ScoreList;
+ScoreList loadRecentScores();
+template <typename R> void updateGame(World &w, const InputFrame &in, double dt);
+void selectRules(RuleSet rs);
+void tickGame(double dt);
+void timerFunc(int);
+void wakeFrameLoop();
+template <typename Buf> void serializeWorld(const World &w, Buf &out);
+bool deserializeWorld(World &w, const uint8_t *data, size_t size);
+bool initPerfCounters();
+void printPerfReport(std::ostream &os);
+void printMemReport(std::ostream &os);
+bool parseMemBudgets(const char* spec);
+void resetTimeTravel();
+void captureTimeTravel(const World &w);
+void scrubTimeTravel(int ticks);
+void resumeFromTimeTravel();
+bool startSpectatorServer(const char* path);
+void publishSpectators(const World &w);
+int runSpectator(int argc, char** argv, const char* path);
+bool startTelemetry();
+void publishTelemetry(double frameMs, double workMs, bool ticked);
+void resyncTelemetryLives();
+int runTelemetryReader(int intervalMs);
+void observeFrameMs(double ms);
+void startMetricsExporter(const char* path);
+void startFlightRecorder(float budgetMs);
+void recordFlightFrame(int timeMs, double frameMs, double tickMs, double publishMs, const InputFrame &in);
+void recordFlightRenderMs(double ms);
+void beginReplayRecording(uint32_t seed);
+void recordReplayTick(double dt, const InputFrame &in);
+void recordReplayEvent(int kind);
+void abandonReplayRecording();
+void finishReplayRecording(const World &w);
+void raceBotGhost(uint32_t seed, int ticks);
+int runBenchmark();
+int runAllocCheck(int ticks, bool windowed, int argc, char** argv);
+int runStress(const char* only, bool windowed, int argc, char** argv);
+void plannerInput(const World &w, InputFrame &in);
+int runPlanner(uint32_t seed, int ticks);
+int runVerifier(int argc, char** argv);
+int runAnalyzer(int argc, char** argv);
+int runMosaic(int argc, char** argv);
+uint32_t beginGhostRace(uint32_t seed);
+void stepGhost();
+void rewindGhost(int ticks);
+bool ghostRacing();
+bool ghostVisible();
+const World &ghostWorld();
+void logSessionEvent(const World &w, int type, int id, float x, float y);
+void saveGameAsync();
+void autosaveTick(double dt);
+void discardSavedGame();
+bool gameInProgress();
+void sessionLogTick(double dt);
 
 // =======================================================
 // Part 5: Utility Drawing Helpers
 // Details: Functions to draw text and rectangles.
 // =======================================================
 
-void drawText(float x, float y, const std::string &s) {
+void drawText(float x, float y, const char* s, void* font) {
     glRasterPos2f(x,y);
-    for(char c : s) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+    for(; *s; ++s) glutBitmapCharacter(font, *s);
 }
 
+void drawText(float x, float y, const std::string &s) { drawText(x, y, s.c_str()); }
+
 void drawRect(float x, float y, float w, float h) {
     glBegin(GL_QUADS);
       glVertex2f(x,y);
@@ -121,7 +681,9 @@ void drawRect(float x, float y, float w, float h) {
 // Details: Reset paddle/ball, generate bricks, start game/level.
 // =======================================================
 
-void resetPaddleAndBall() {
+void resetPaddleAndBall(World &w) {
+    Paddle &paddle = w.paddle;
+    Ball &ball = w.ball;
     paddle.w = 120.0f;
     paddle.h = 16.0f;
     paddle.x = (WIN_W - paddle.w) / 2.0f;
@@ -138,48 +700,102 @@ void resetPaddleAndBall() {
     ball.fireballTimer = 0.0f;
 }
 
-void createBricksForLevel(int level) {
-    bricks.clear();
-    perks.clear();
-    projectiles.clear();
+// Builds a level layout into 'out'. Touches no globals, so it is safe to run
+// on the prefetch worker.
+void generateLevel(int level, uint32_t seed, float perkDropProb, BrickStore &out, int &count) {
+    Rng rng(seed);
+    out.clear();
     int rows = std::min(3 + level, 8);
     int cols = 10;
     float margin = 60.0f, gap = 6.0f;
     float brickW = (WIN_W - 2*margin - (cols-1)*gap) / cols;
     float brickH = 22.0f;
     float startY = WIN_H - 100.0f;
-    bricksRemaining = 0;
+    count = 0;
 
     for (int r=0;r<rows;++r) {
         for (int c=0;c<cols;++c) {
-            Brick b;
-            b.w = brickW; b.h = brickH;
-            b.x = margin + c * (brickW + gap);
-            b.y = startY - r * (brickH + gap);
-            b.hits = ((rand()%100) < (std::max(0, level - 1) * 15)) ? 2 : 1;
-            b.alive = true;
-            b.type = ((rand()/(RAND_MAX+1.0f)) < (PERK_DROP_PROB + 0.02f*(level-1))) ? 1 : 0;
-            bricks.push_back(b);
-            bricksRemaining++;
+            int hits = (rng.range(100) < (std::max(0, level - 1) * 15)) ? 2 : 1;
+            int type = (rng.unit() < (perkDropProb + 0.02f*(level-1))) ? 1 : 0;
+            out.add(margin + c * (brickW + gap), startY - r * (brickH + gap), brickW, brickH, hits, type);
+            count++;
         }
     }
-    ball.speed = 380.0f + (level - 1) * 30.0f;
-    if (ball.speed > BALL_SPEED_MAX) ball.speed = BALL_SPEED_MAX;
+    out.fitGrid();
+}
+
+// Next level, generated on a worker while the level-clear screen is up.
+std::future<PreparedLevel> pendingLevel;
+int pendingLevelNumber = 0;
+
+void createBricksForLevel(World &w, int level) {
+    w.perks.clear();
+    w.projectiles.clear();
+    if (&w == &world && pendingLevel.valid() && pendingLevelNumber == level) {
+        // Swap the prefetched layout in; get() only waits if space was
+        // pressed before the worker finished.
+        PreparedLevel pl = pendingLevel.get();
+        std::swap(w.bricks, pl.bricks);
+        w.bricksRemaining = pl.count;
+    } else {
+        generateLevel(level, w.rng.next(), activeRules->perkDropProb, w.bricks, w.bricksRemaining);
+    }
+    w.ball.speed = 380.0f + (level - 1) * 30.0f;
+    if (w.ball.speed > activeRules->ballSpeedMax) w.ball.speed = activeRules->ballSpeedMax;
+    attachLevelScripts(w);
+}
+
+void prefetchLevel(int level) {
+    // The seed is drawn here so the worker never touches the world.
+    uint32_t seed = world.rng.next();
+    float dropProb = activeRules->perkDropProb;
+    pendingLevelNumber = level;
+    pendingLevel = std::async(std::launch::async, [level, seed, dropProb]() {
+        PreparedLevel pl;
+        pl.level = level;
+        generateLevel(level, seed, dropProb, pl.bricks, pl.count);
+        return pl;
+    });
+}
+
+// Puts 'w' at the start of a fresh game on level 1.
+void resetWorld(World &w, uint32_t seed) {
+    w.rng = Rng(seed);
+    w.currentLevel = 1;
+    w.score = 0; w.lives = 3;
+    w.fireCooldown = 0.0f;
+    w.outcome = WO_NONE;
+    w.perks.reserve(PERK_CAPACITY);
+    w.projectiles.reserve(PROJECTILE_CAPACITY);
+    createBricksForLevel(w, w.currentLevel);
+    resetPaddleAndBall(w);
+}
+
+// Starts 'level' on 'w' with a fresh paddle and ball; score and lives carry over.
+void beginLevel(World &w, int level) {
+    w.currentLevel = level;
+    w.outcome = WO_NONE;
+    createBricksForLevel(w, level);
+    resetPaddleAndBall(w);
 }
 
 void startNewGame() {
-    currentLevel = 1;
-    score = 0; lives = 3;
-    createBricksForLevel(currentLevel);
-    resetPaddleAndBall();
+    uint32_t seed = beginGhostRace((uint32_t)rand());
+    pendingLevelNumber = 0; // A prefetch from an abandoned game is never used
+    resetWorld(world, seed);
+    resyncTelemetryLives();
+    logSessionEvent(world, SE_GAME_START, activeRuleSet, 0, 0);
+    resetTimeTravel();
+    beginReplayRecording(seed);
     gameStartTime = glutGet(GLUT_ELAPSED_TIME);
     elapsedTime = 0.0;
     gameState = GS_PLAYING;
 }
 
 void startLevel(int level) {
-    createBricksForLevel(level);
-    resetPaddleAndBall();
+    recordReplayEvent(level == world.currentLevel ? 2 /* RR_RESTART_LEVEL */ : 1 /* RR_NEXT_LEVEL */);
+    beginLevel(world, level);
+    logSessionEvent(world, SE_LEVEL_START, 0, 0, 0);
     gameStartTime = glutGet(GLUT_ELAPSED_TIME);
     elapsedTime = 0.0;
     gameState = GS_PLAYING;
@@ -190,32 +806,41 @@ void startLevel(int level) {
 // Details: Spawning and applying effects of power-ups.
 // =======================================================
 
-void spawnPerk(float x,float y) {
+void spawnPerk(World &w, float x,float y) {
     Perk p; p.x = x; p.y = y; p.vy = -150.0f; p.alive=true;
-    int t = rand()%100;
+    int t = w.rng.range(100);
     if (t < 35) p.type=0;         // Extra Life (35%)
     else if (t < 65) p.type=1;    // Wide Paddle (30%)
     else if (t < 80) p.type=2;    // Speed Ball (15%)
     else if (t < 90) p.type=3;    // Fireball (10%)
     else if (t < 97) p.type=4;    // Shrink Paddle (7%)
     else p.type=5;                // Instant Death (3%)
-    perks.push_back(p);
+    w.perks.push_back(p);
+    metricAdd(M_PERK_SPAWNED_0 + p.type);
+    logSessionEvent(w, SE_PERK_SPAWN, p.type, x, y);
+}
+
+// Where x falls along the paddle: -1 at its left edge, 1 at its right.
+inline float paddleOffset(const Paddle &paddle, float x) {
+    return (x - (paddle.x + paddle.w*0.5f)) / (paddle.w*0.5f);
 }
 
-void applyPerk(Perk &p) {
-    if (p.type==0) lives++;
-    else if (p.type==1) { paddle.w += 40.0f; if (paddle.w>280.0f) paddle.w=280.0f; }
-    else if (p.type==2) { ball.speed *= 1.15f; if (ball.speed>BALL_SPEED_MAX) ball.speed=BALL_SPEED_MAX; }
-    else if (p.type==3) { ball.isFireball = true; ball.fireballTimer = 10.0f; }
-    else if (p.type==4) { paddle.w -= 30.0f; if (paddle.w<40.0f) paddle.w=40.0f; }
+template <typename R>
+void applyPerk(World &w, Perk &p) {
+    Paddle &paddle = w.paddle;
+    Ball &ball = w.ball;
+    logSessionEvent(w, SE_PERK_CATCH, p.type, p.x, 1000.0f * paddleOffset(paddle, p.x));
+    if (p.type==0) w.lives++;
+    else if (p.type==1) { paddle.w += 40.0f; if (paddle.w>R::paddleWMax()) paddle.w=R::paddleWMax(); }
+    else if (p.type==2) { ball.speed *= 1.15f; if (ball.speed>R::ballSpeedMax()) ball.speed=R::ballSpeedMax(); }
+    else if (p.type==3) { ball.isFireball = true; ball.fireballTimer = 10.0f; w.scripts.signal(SEV_FIREBALL); }
+    else if (p.type==4) { paddle.w -= 30.0f; if (paddle.w<R::paddleWMin()) paddle.w=R::paddleWMin(); }
     else if (p.type==5) {
-        lives--;
-        if (lives <= 0) {
-            saveScore(score);
-            saveHighScore(score);
-            gameState = GS_GAMEOVER;
+        if (R::loseLives()) w.lives--;
+        if (w.lives <= 0) {
+            w.outcome = WO_GAME_OVER;
         } else {
-            resetPaddleAndBall();
+            resetPaddleAndBall(w);
         }
     }
     p.alive=false;
@@ -226,15 +851,16 @@ void applyPerk(Perk &p) {
 // Details: Ball launch, wall/paddle/brick collision, etc.
 // =======================================================
 
-void launchBall() {
+void launchBall(World &w) {
+    Ball &ball = w.ball;
     if (!ball.stuck) return;
     ball.stuck = false;
-    float angle = M_PI/3.0f + (rand()%100 - 50) * 0.004f;
+    float angle = M_PI/3.0f + (w.rng.range(100) - 50) * 0.004f;
     ball.vx = ball.speed * cosf(angle);
     ball.vy = ball.speed * sinf(angle);
 }
 
-void normalizeBallVelocity() {
+void normalizeBallVelocity(Ball &ball) {
     float vmag = sqrtf(ball.vx*ball.vx + ball.vy*ball.vy);
     if (vmag > 0.0001f) {
         ball.vx *= ball.speed / vmag;
@@ -242,138 +868,548 @@ void normalizeBallVelocity() {
     }
 }
 
-void bounceBallOffPaddle() {
-    float rel = (ball.x - (paddle.x + paddle.w*0.5f)) / (paddle.w*0.5f);
+void bounceBallOffPaddle(Ball &ball, const Paddle &paddle) {
+    float rel = paddleOffset(paddle, ball.x);
     float angle = (M_PI/2.0f) + rel * (75.0f * M_PI/180.0f);
     ball.y = paddle.y + paddle.h + ball.radius + 1.0f;
     ball.vx = ball.speed * cosf(angle);
     ball.vy = ball.speed * sinf(angle);
 }
 
-void handleWallCollisions() {
-    if (ball.x - ball.radius <= 0) { ball.x = ball.radius; ball.vx = -ball.vx; }
-    if (ball.x + ball.radius >= WIN_W) { ball.x = WIN_W - ball.radius; ball.vx = -ball.vx; }
-    if (ball.y + ball.radius >= WIN_H) { ball.y = WIN_H - ball.radius; ball.vy = -ball.vy; }
+// Returns the number of walls the ball bounced off.
+int handleWallCollisions(Ball &ball) {
+    int hits = 0;
+    if (ball.x - ball.radius <= 0) { ball.x = ball.radius; ball.vx = -ball.vx; hits++; }
+    if (ball.x + ball.radius >= WIN_W) { ball.x = WIN_W - ball.radius; ball.vx = -ball.vx; hits++; }
+    if (ball.y + ball.radius >= WIN_H) { ball.y = WIN_H - ball.radius; ball.vy = -ball.vy; hits++; }
+    return hits;
 }
 
-void handlePaddleCollision() {
+bool handlePaddleCollision(Ball &ball, const Paddle &paddle) {
     if (ball.vy < 0 && ball.x+ball.radius > paddle.x && ball.x-ball.radius < paddle.x+paddle.w && ball.y-ball.radius < paddle.y+paddle.h && ball.y+ball.radius > paddle.y) {
-        bounceBallOffPaddle();
+        bounceBallOffPaddle(ball, paddle);
+        return true;
     }
+    return false;
 }
 
-void handleBrickCollisions() {
-    for (auto &b : bricks) {
+void handleBrickCollisions(World &w) {
+    Ball &ball = w.ball;
+    BrickStore &bricks = w.bricks;
+    BrickHot* hot = bricks.hot.data();
+    const float *bx = bricks.x.data(), *by = bricks.y.data(), *bw = bricks.w.data(), *bh = bricks.h.data();
+    for (int i : bricks.live) {
+        BrickHot &b = hot[i];
         if (!b.alive) continue;
-        if (ball.x+ball.radius > b.x && ball.x-ball.radius < b.x+b.w && ball.y+ball.radius > b.y && ball.y-ball.radius < b.y+b.h) {
+        if (ball.x+ball.radius > bx[i] && ball.x-ball.radius < bx[i]+bw[i] && ball.y+ball.radius > by[i] && ball.y-ball.radius < by[i]+bh[i]) {
+            w.counters.brickHits++;
             if (ball.isFireball) {
-                b.alive = false; bricksRemaining--; score += 10;
-                if (b.type==1) spawnPerk(b.x + b.w/2, b.y + b.h/2);
+                bricks.kill(i); w.bricksRemaining--; w.score += 10; metricAdd(M_BRICKS_DESTROYED);
+                logSessionEvent(w, SE_BRICK_KILL, i, bx[i] + bw[i]/2, by[i] + bh[i]/2);
+                if (b.type==1) spawnPerk(w, bx[i] + bw[i]/2, by[i] + bh[i]/2);
             } else {
-                float overlapX = (b.w/2 + ball.radius) - fabs(ball.x - (b.x + b.w/2));
-                float overlapY = (b.h/2 + ball.radius) - fabs(ball.y - (b.y + b.h/2));
+                float overlapX = (bw[i]/2 + ball.radius) - fabs(ball.x - (bx[i] + bw[i]/2));
+                float overlapY = (bh[i]/2 + ball.radius) - fabs(ball.y - (by[i] + bh[i]/2));
                 if (overlapX < overlapY) ball.vx = -ball.vx;
                 else ball.vy = -ball.vy;
 
-                b.hits--;
+                bricks.damage(i);
                 if (b.hits <= 0) {
-                    b.alive = false; bricksRemaining--; score += 10;
-                    if (b.type==1) spawnPerk(b.x + b.w/2, b.y + b.h/2);
-                } else score += 5;
+                    bricks.kill(i); w.bricksRemaining--; w.score += 10; metricAdd(M_BRICKS_DESTROYED);
+                    logSessionEvent(w, SE_BRICK_KILL, i, bx[i] + bw[i]/2, by[i] + bh[i]/2);
+                    if (b.type==1) spawnPerk(w, bx[i] + bw[i]/2, by[i] + bh[i]/2);
+                } else {
+                    w.score += 5;
+                    logSessionEvent(w, SE_BRICK_HIT, i, bx[i] + bw[i]/2, by[i] + bh[i]/2);
+                }
                 break;
             }
         }
     }
 }
 
-void handlePerks(double dt) {
-    for (auto &p : perks) {
+template <typename R>
+void handlePerks(World &w, double dt) {
+    const Paddle &paddle = w.paddle;
+    for (auto &p : w.perks) {
         if (!p.alive) continue;
         p.y += p.vy * dt;
-        if (p.y < -40) p.alive=false;
+        if (p.y < -40) { p.alive=false; logSessionEvent(w, SE_PERK_MISS, p.type, p.x, p.y); }
         if (p.x > paddle.x && p.x < paddle.x+paddle.w && p.y < paddle.y+paddle.h && p.y > paddle.y) {
-            applyPerk(p);
+            w.counters.perksCaught++;
+            metricAdd(M_PERK_CAUGHT_0 + p.type);
+            applyPerk<R>(w, p);
+        }
+    }
+}
+
+// Bricks strictly containing (px, py), in live order. A lattice is queried
+// through its 3x3 neighbourhood (the fit allows a little slack) instead of a
+// scan; in either case no point lies in more than BRICK_CANDIDATES bricks.
+const int BRICK_CANDIDATES = 9;
+
+int bricksAt(const BrickStore &bs, float px, float py, int *out) {
+    const float *bx = bs.x.data(), *by = bs.y.data(), *bw = bs.w.data(), *bh = bs.h.data();
+    int n = 0;
+    const BrickGrid &g = bs.grid;
+    if (g.cols == 0) {
+        for (int i : bs.live)
+            if (bs.hot[i].alive && px>bx[i] && px<bx[i]+bw[i] && py>by[i] && py<by[i]+bh[i] && n < BRICK_CANDIDATES) out[n++] = i;
+        return n;
+    }
+    int c0 = (int)floorf((px - g.x) / g.pitchX), r0 = (int)floorf((g.y - py) / g.pitchY);
+    for (int r = std::max(r0 - 1, 0); r <= std::min(r0 + 1, g.rows - 1); ++r)
+        for (int c = std::max(c0 - 1, 0); c <= std::min(c0 + 1, g.cols - 1); ++c) {
+            int i = r * g.cols + c;
+            if (bs.hot[i].alive && px>bx[i] && px<bx[i]+bw[i] && py>by[i] && py<by[i]+bh[i]) out[n++] = i;
+        }
+    return n;
+}
+
+// Damages the first candidate still standing. Returns whether one was hit.
+bool hitFirstStanding(World &w, const int *cand, int n) {
+    BrickStore &bricks = w.bricks;
+    const float *bx = bricks.x.data(), *by = bricks.y.data(), *bw = bricks.w.data(), *bh = bricks.h.data();
+    for (int k = 0; k < n; ++k) {
+        int i = cand[k];
+        BrickHot &b = bricks.hot[i];
+        if (!b.alive) continue;
+        w.counters.brickHits++;
+        bricks.damage(i);
+        if (b.hits <= 0) {
+            bricks.kill(i); w.bricksRemaining--; w.score += 10; metricAdd(M_BRICKS_DESTROYED);
+            logSessionEvent(w, SE_BRICK_KILL, i, bx[i]+bw[i]/2, by[i]+bh[i]/2);
+            if (b.type==1) spawnPerk(w, bx[i]+bw[i]/2, by[i]+bh[i]/2);
+        } else {
+            w.score += 5;
+            logSessionEvent(w, SE_BRICK_HIT, i, bx[i]+bw[i]/2, by[i]+bh[i]/2);
         }
+        return true;
+    }
+    return false;
+}
+
+// Intra-world parallelism for very large single worlds. Projectiles are split
+// into vertical stripes by x; each stripe moves its shots and looks up the
+// bricks under them against the field as it stood at the start of the pass,
+// writing hits to its own commit buffer. The buffers are then merged by shot
+// index and applied on the calling thread, so damage, score and perk spawns
+// (which draw from the world's rng) happen in exactly the serial order. Only
+// worlds with at least PARALLEL_PROJECTILES shots are split.
+const size_t PARALLEL_PROJECTILES = 4096;
+const int MAX_SIM_THREADS = 16;
+
+struct StripeHit {
+    int shot, n;
+    int cand[BRICK_CANDIDATES];
+};
+
+struct SimWorkers {
+    int threads = 0;                     // Stripes per pass, caller included; 0 = not chosen yet
+    std::vector<std::thread> pool;
+    std::mutex mu;
+    std::condition_variable wake, done;
+    uint64_t generation = 0;
+    int pending = 0;
+    bool stop = false;
+    void (*job)(int stripe) = nullptr;
+    std::vector<StripeHit> hits[MAX_SIM_THREADS];   // Per-stripe commit buffers
+    World *w = nullptr;                  // Current pass
+    double dt = 0.0;
+} simWorkers;
+
+void simWorkerLoop(int stripe) {
+    SimWorkers &sw = simWorkers;
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(sw.mu);
+    for (;;) {
+        sw.wake.wait(lock, [&] { return sw.stop || sw.generation != seen; });
+        if (sw.stop) return;
+        seen = sw.generation;
+        lock.unlock();
+        sw.job(stripe);
+        lock.lock();
+        if (--sw.pending == 0) sw.done.notify_one();
+    }
+}
+
+void stopSimWorkers() {
+    SimWorkers &sw = simWorkers;
+    {
+        std::lock_guard<std::mutex> lock(sw.mu);
+        sw.stop = true;
+    }
+    sw.wake.notify_all();
+    for (auto &t : sw.pool) t.join();
+    sw.pool.clear();
+}
+
+// --sim-threads N; defaults to the hardware thread count. 1 keeps every
+// world on the calling thread.
+int simThreads() {
+    SimWorkers &sw = simWorkers;
+    if (sw.threads == 0) sw.threads = (int)std::thread::hardware_concurrency();
+    sw.threads = std::max(1, std::min(sw.threads, MAX_SIM_THREADS));
+    if (sw.threads > 1 && sw.pool.empty()) {
+        for (int s = 1; s < sw.threads; ++s) sw.pool.emplace_back(simWorkerLoop, s);
+        atexit(stopSimWorkers);
     }
+    return sw.threads;
 }
 
-void handleProjectiles(double dt) {
-    for (auto &p : projectiles) {
+// Runs job(stripe) for every stripe, stripe 0 on the calling thread.
+void runStripes(void (*job)(int stripe)) {
+    SimWorkers &sw = simWorkers;
+    {
+        std::lock_guard<std::mutex> lock(sw.mu);
+        sw.job = job;
+        sw.pending = sw.threads - 1;
+        sw.generation++;
+    }
+    sw.wake.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> lock(sw.mu);
+    sw.done.wait(lock, [&] { return sw.pending == 0; });
+}
+
+void projectileStripe(int stripe) {
+    SimWorkers &sw = simWorkers;
+    World &w = *sw.w;
+    std::vector<StripeHit> &out = sw.hits[stripe];
+    out.clear();
+    const int stripes = sw.threads;
+    Projectile *shots = w.projectiles.data();
+    const int count = (int)w.projectiles.size();
+    StripeHit h;
+    for (int s = 0; s < count; ++s) {
+        Projectile &p = shots[s];
         if (!p.alive) continue;
-        p.y += p.vy * dt;
+        int owner = std::max(0, std::min(stripes - 1, (int)(p.x * stripes / WIN_W)));
+        if (owner != stripe) continue;
+        p.y += p.vy * sw.dt;
         if (p.y > WIN_H) p.alive = false;
+        h.n = bricksAt(w.bricks, p.x, p.y, h.cand);
+        if (h.n == 0) continue;
+        h.shot = s;
+        out.push_back(h);
+    }
+}
 
-        for (auto &b : bricks) {
-            if (b.alive && p.x>b.x && p.x<b.x+b.w && p.y>b.y && p.y<b.y+b.h) {
-                p.alive = false;
-                b.hits--;
-                if (b.hits <= 0) {
-                    b.alive = false; bricksRemaining--; score += 10;
-                    if (b.type==1) spawnPerk(b.x+b.w/2, b.y+b.h/2);
-                } else score += 5;
-                break;
-            }
-        }
+void handleProjectilesStriped(World &w, double dt) {
+    SimWorkers &sw = simWorkers;
+    sw.w = &w;
+    sw.dt = dt;
+    runStripes(projectileStripe);
+    // Each buffer is in shot order; merge them so hits apply in that order.
+    size_t next[MAX_SIM_THREADS] = {};
+    for (;;) {
+        int best = -1;
+        for (int s = 0; s < sw.threads; ++s)
+            if (next[s] < sw.hits[s].size() && (best < 0 || sw.hits[s][next[s]].shot < sw.hits[best][next[best]].shot)) best = s;
+        if (best < 0) break;
+        const StripeHit &h = sw.hits[best][next[best]++];
+        if (hitFirstStanding(w, h.cand, h.n)) w.projectiles[h.shot].alive = false;
+    }
+}
+
+void handleProjectiles(World &w, double dt) {
+    if (w.projectiles.size() >= PARALLEL_PROJECTILES && !quietSim && simThreads() > 1) { handleProjectilesStriped(w, dt); return; }
+    int cand[BRICK_CANDIDATES];
+    for (auto &p : w.projectiles) {
+        if (!p.alive) continue;
+        p.y += p.vy * dt;
+        if (p.y > WIN_H) p.alive = false;
+        int n = bricksAt(w.bricks, p.x, p.y, cand);
+        if (hitFirstStanding(w, cand, n)) p.alive = false;
     }
 }
 
 // =======================================================
 // Part 9: Game Update Loop
-// Details: Movement, state changes, level progression.
+// Details: Movement, state changes, level progression and level scripts.
 // =======================================================
 
-void increaseBallSpeedOverTime(double dt) {
+template <typename R>
+void increaseBallSpeedOverTime(Ball &ball, double dt) {
     if (!ball.stuck) {
-        ball.speed += BALL_SPEED_INCREASE_RATE * dt;
-        if (ball.speed > BALL_SPEED_MAX) ball.speed = BALL_SPEED_MAX;
-        normalizeBallVelocity();
+        ball.speed += R::ballSpeedIncreaseRate() * dt;
+        if (ball.speed > R::ballSpeedMax()) ball.speed = R::ballSpeedMax();
+        normalizeBallVelocity(ball);
     }
 }
 
-void updateGame(double dt) {
-    if (gameState != GS_PLAYING) return;
-    elapsedTime = (glutGet(GLUT_ELAPSED_TIME) - gameStartTime) / 1000.0;
-    if (fireCooldown > 0) fireCooldown -= dt;
+// Mouse position, launch and fire requests gathered since the last tick.
+template <typename R>
+void applyInput(World &w, const InputFrame &in) {
+    Paddle &paddle = w.paddle;
+    if (in.mouseMoved) {
+        paddle.x = in.mouseX - paddle.w*0.5f;
+        if (w.ball.stuck) w.ball.x = paddle.x + paddle.w*0.5f;
+    }
+    if (in.launch) launchBall(w);
+    if (in.fire && w.fireCooldown <= 0) {
+        w.projectiles.push_back({paddle.x + 10, paddle.y + paddle.h, 500.0f, true});
+        w.projectiles.push_back({paddle.x + paddle.w - 10, paddle.y + paddle.h, 500.0f, true});
+        w.fireCooldown = R::fireRate();
+        metricAdd(M_PROJECTILES_FIRED, 2);
+    }
+}
+
+// Level scripts. A script is a plain function resumed at t.pc; before it
+// returns it either sets what to wait for next (waitFor*) or finishes the
+// task. Scripts only run through resumeScripts, never from a polling loop.
+enum LevelScript { LS_REFILL_TOP_ROW, LS_FLIP_PALETTE, LS_FIREBALL_MUSIC, LS_COUNT };
+
+const float PALETTE_FLIP_SECONDS = 10.0f;
+
+inline void waitForTime(World &w, ScriptTask &t, float seconds) { t.wakeAt = w.scripts.clock + seconds; }
+inline void waitForBricksLeft(ScriptTask &t, int n) { t.wakeBricks = n; }
+inline void waitForEvent(ScriptTask &t, int ev) { t.waitEvents |= (uint8_t)(1u << ev); }
+
+// Music belongs to the player, not to rollouts, ghosts or replays.
+void scriptMusic(const World &w, bool fast) {
+    if (&w == &world) setMusicFast(fast);
+}
 
-    if (ball.isFireball) {
-        ball.fireballTimer -= dt;
-        if (ball.fireballTimer <= 0) ball.isFireball = false;
+// Stands the top row of a lattice back up. Runs between ticks, when the live
+// list is compact, and rebuilds it in creation order.
+void reviveTopRow(World &w) {
+    BrickStore &bs = w.bricks;
+    if (bs.grid.cols == 0) return;
+    for (int i = 0; i < bs.grid.cols; ++i) {
+        BrickHot &b = bs.hot[i];
+        if (b.alive) continue;
+        b.alive = 1; b.hits = 1;
+        bs.dirty.add(i);
+        w.bricksRemaining++;
     }
+    bs.live.clear();
+    for (int i = 0; i < bs.size(); ++i) if (bs.hot[i].alive) bs.live.push_back(i);
+}
 
-    float mv = paddle.speed * dt;
-    if (keyLeft) paddle.x -= mv;
-    if (keyRight) paddle.x += mv;
-    if (paddle.x < 0) paddle.x = 0;
-    if (paddle.x + paddle.w > WIN_W) paddle.x = WIN_W - paddle.w;
+// Once half the field is gone, lay the top row again.
+void scriptRefillTopRow(World &w, ScriptTask &t) {
+    switch (t.pc) {
+    case 0:
+        waitForBricksLeft(t, w.bricksRemaining / 2);
+        t.pc = 1;
+        return;
+    case 1:
+        reviveTopRow(w);
+        t.pc = SCRIPT_DONE;
+        return;
+    }
+}
 
-    if (ball.stuck) {
-        ball.x = paddle.x + paddle.w/2.0f;
-    } else {
-        ball.x += ball.vx * dt;
-        ball.y += ball.vy * dt;
+// Every PALETTE_FLIP_SECONDS, swap the brick colours.
+void scriptFlipPalette(World &w, ScriptTask &t) {
+    if (t.pc == 1) w.scripts.palette ^= 1;
+    waitForTime(w, t, PALETTE_FLIP_SECONDS);
+    t.pc = 1;
+}
+
+// Fast music for as long as a fireball burns; catching another one while it
+// burns extends the wait.
+void scriptFireballMusic(World &w, ScriptTask &t) {
+    switch (t.pc) {
+    case 0:
+        waitForEvent(t, SEV_FIREBALL);
+        t.pc = 1;
+        return;
+    case 1:
+        scriptMusic(w, true);
+        waitForTime(w, t, w.ball.fireballTimer);
+        t.pc = 2;
+        return;
+    case 2:
+        if (w.ball.isFireball && w.ball.fireballTimer > 0) { waitForTime(w, t, w.ball.fireballTimer); return; }
+        scriptMusic(w, false);
+        waitForEvent(t, SEV_FIREBALL);
+        t.pc = 1;
+        return;
+    }
+}
+
+// Puts the music back in step with a world whose scheduler was just loaded
+// from an image: fast while a fireball-music task is waiting out its fireball.
+void syncScriptMusic(const World &w) {
+    bool fast = false;
+    for (int k = 0; k < w.scripts.count; ++k)
+        if (w.scripts.tasks[k].script == LS_FIREBALL_MUSIC && w.scripts.tasks[k].pc == 2) fast = true;
+    scriptMusic(w, fast);
+}
+
+typedef void (*LevelScriptFn)(World &w, ScriptTask &t);
+const LevelScriptFn LEVEL_SCRIPTS[LS_COUNT] = { scriptRefillTopRow, scriptFlipPalette, scriptFireballMusic };
+
+// Refreshes the scheduler's cached wake conditions from its tasks, dropping
+// finished ones.
+void rescheduleScripts(ScriptScheduler &sc) {
+    int n = 0;
+    sc.nextWake = INFINITY;
+    sc.wakeBricks = -1;
+    sc.waitEvents = 0;
+    for (int k = 0; k < sc.count; ++k) {
+        const ScriptTask &t = sc.tasks[k];
+        if (t.pc == SCRIPT_DONE) continue;
+        sc.nextWake = std::min(sc.nextWake, t.wakeAt);
+        sc.wakeBricks = std::max(sc.wakeBricks, t.wakeBricks);
+        sc.waitEvents |= t.waitEvents;
+        sc.tasks[n++] = t;
+    }
+    sc.count = n;
+}
+
+// Resumes every task whose condition fired, then reschedules.
+void resumeScripts(World &w) {
+    ScriptScheduler &sc = w.scripts;
+    uint8_t signals = sc.signals;
+    sc.signals = 0;
+    for (int k = 0; k < sc.count; ++k) {
+        ScriptTask &t = sc.tasks[k];
+        bool due = sc.clock >= t.wakeAt || w.bricksRemaining <= t.wakeBricks || (signals & t.waitEvents);
+        if (!due) continue;
+        t.wakeAt = INFINITY; t.wakeBricks = -1; t.waitEvents = 0;
+        LEVEL_SCRIPTS[t.script](w, t);
+    }
+    rescheduleScripts(sc);
+}
+
+inline void tickScripts(World &w, double dt) {
+    ScriptScheduler &sc = w.scripts;
+    sc.clock += (float)dt;
+    if (sc.clock >= sc.nextWake || w.bricksRemaining <= sc.wakeBricks || sc.signals) resumeScripts(w);
+}
+
+// Levels 1-4 are the unscripted introduction. From level 5 odd levels refill
+// their top row halfway through, even ones flip their palette, and all of
+// them speed the music up during a fireball.
+void attachLevelScripts(World &w) {
+    ScriptScheduler &sc = w.scripts;
+    sc = ScriptScheduler();
+    if (&w == &world) setMusicFast(false);
+    int level = w.currentLevel;
+    if (level < 5) return;
+    uint8_t ids[MAX_LEVEL_SCRIPTS];
+    int n = 0;
+    ids[n++] = level % 2 ? LS_REFILL_TOP_ROW : LS_FLIP_PALETTE;
+    ids[n++] = LS_FIREBALL_MUSIC;
+    for (int k = 0; k < n; ++k) {
+        ScriptTask &t = sc.tasks[k];
+        t.script = ids[k]; t.pc = 0;
+        t.wakeAt = INFINITY; t.wakeBricks = -1; t.waitEvents = 0;
+        LEVEL_SCRIPTS[t.script](w, t);
+    }
+    sc.count = n;
+    rescheduleScripts(sc);
+}
+
+template <typename R>
+void updateGame(World &w, const InputFrame &in, double dt) {
+    if (w.outcome != WO_NONE) return;
+    Ball &ball = w.ball;
+    Paddle &paddle = w.paddle;
+    if (w.fireCooldown > 0) w.fireCooldown -= dt;
+    { PerfScope ps(PH_INPUT); applyInput<R>(w, in); }
+
+    {
+        PerfScope ps(PH_MOVE);
+        if (ball.isFireball) {
+            ball.fireballTimer -= dt;
+            if (ball.fireballTimer <= 0) ball.isFireball = false;
+        }
+
+        float mv = paddle.speed * dt;
+        if (in.left) paddle.x -= mv;
+        if (in.right) paddle.x += mv;
+        if (paddle.x < 0) paddle.x = 0;
+        if (paddle.x + paddle.w > WIN_W) paddle.x = WIN_W - paddle.w;
+
+        if (ball.stuck) {
+            ball.x = paddle.x + paddle.w/2.0f;
+        } else {
+            ball.x += ball.vx * dt;
+            ball.y += ball.vy * dt;
+        }
     }
 
-    handleWallCollisions();
+    { PerfScope ps(PH_WALLS); w.counters.wallHits += handleWallCollisions(ball); }
     if (ball.y - ball.radius <= 0) {
-        lives--;
-        if (lives <= 0) {
-            saveScore(score);
-            saveHighScore(score);
-            gameState = GS_GAMEOVER;
+        metricAdd(M_BALLS_LOST);
+        logSessionEvent(w, SE_BALL_LOST, 0, ball.x, ball.y);
+        if (R::loseLives()) w.lives--;
+        if (w.lives <= 0) {
+            w.outcome = WO_GAME_OVER;
         } else {
-            resetPaddleAndBall();
+            resetPaddleAndBall(w);
         }
         return;
     }
-    handlePaddleCollision();
-    handleBrickCollisions();
-    handlePerks(dt);
-    handleProjectiles(dt);
-    increaseBallSpeedOverTime(dt);
+    {
+        PerfScope ps(PH_PADDLE);
+        if (handlePaddleCollision(ball, paddle)) {
+            w.counters.paddleHits++;
+            logSessionEvent(w, SE_PADDLE_HIT, 0, ball.x, 1000.0f * paddleOffset(paddle, ball.x));
+        }
+    }
+    { PerfScope ps(PH_BRICKS); handleBrickCollisions(w); }
+    { PerfScope ps(PH_PERKS); handlePerks<R>(w, dt); }
+    { PerfScope ps(PH_PROJECTILES); handleProjectiles(w, dt); }
+    { PerfScope ps(PH_COMPACT); w.bricks.compact(); compactDead(w.perks); compactDead(w.projectiles); }
+    if (w.scripts.count) tickScripts(w, dt);
+    { PerfScope ps(PH_SPEED); increaseBallSpeedOverTime<R>(ball, dt); }
+
+    if (w.bricksRemaining <= 0) {
+        if (R::endless()) {
+            // Refill the field in place; the ball stays in play.
+            w.currentLevel++;
+            generateLevel(w.currentLevel, w.rng.next(), R::perkDropProb(), w.bricks, w.bricksRemaining);
+            attachLevelScripts(w);
+            logSessionEvent(w, SE_LEVEL_START, 0, 0, 0);
+        } else {
+            w.outcome = WO_LEVEL_CLEAR;
+        }
+    }
+}
+
+// Runtime dispatch: the preset is picked once when a game starts, and every
+// tick after that goes straight to its specialised instantiation.
+UpdateFn updateGameFn = updateGame<ClassicRules>;
+
+void selectRules(RuleSet rs) {
+    activeRuleSet = rs;
+    activeRules = &RULE_PARAMS[rs];
+    switch (rs) {
+        case RULES_HARD:     updateGameFn = updateGame<HardRules>; break;
+        case RULES_ENDLESS:  updateGameFn = updateGame<EndlessRules>; break;
+        case RULES_TRAINING: updateGameFn = updateGame<TrainingRules>; break;
+        default:             updateGameFn = updateGame<ClassicRules>; break;
+    }
+}
+
+// Steps the live world with this frame's input and turns its outcome into a
+// screen change. Score files are only written from here, never from the
+// simulation itself.
+void tickGame(double dt) {
+    elapsedTime = (glutGet(GLUT_ELAPSED_TIME) - gameStartTime) / 1000.0;
+    recordReplayTick(dt, input);
+    sessionLogTick(dt);
+    updateGameFn(world, input, dt);
+    stepGhost();
+    captureTimeTravel(world);
+    autosaveTick(dt);
 
-    if (bricksRemaining <= 0) {
-        saveScore(score);
+    if (world.outcome == WO_GAME_OVER) {
+        logSessionEvent(world, SE_GAME_OVER, 0, 0, 0);
+        discardSavedGame();
+        finishReplayRecording(world);
+        saveScore(world.score);
+        saveHighScore(world.score);
+        gameState = GS_GAMEOVER;
+    } else if (world.outcome == WO_LEVEL_CLEAR) {
+        saveScore(world.score);
         gameState = GS_LEVEL_CLEAR;
+        prefetchLevel(world.currentLevel + 1);
     }
 }
 
@@ -382,26 +1418,39 @@ void updateGame(double dt) {
 // Details: Saving and loading recent scores and high score.
 // =======================================================
 
+// The scoreboard reads from this cache; it is reloaded after a score is saved.
+ScoreList recentScores;
+bool recentScoresDirty = true;
+
 void saveScore(int s) {
-    std::vector<int> scores = loadRecentScores();
+    if (headless) return;
+    recentScoresDirty = true;
+    ScoreList scores = loadRecentScores();
     scores.insert(scores.begin(), s);
     if ((int)scores.size() > MAX_RECENT) scores.resize(MAX_RECENT);
     std::ofstream ofs(SCORE_FILE, std::ios::trunc);
-    if (ofs) for (int val : scores) ofs << val << "\n";
+    if (ofs) {
+        for (int val : scores) ofs << val << "\n";
+        metricAdd(M_DISK_WRITES);
+    }
 }
 
-std::vector<int> loadRecentScores() {
-    std::vector<int> v;
+ScoreList loadRecentScores() {
+    ScoreList v;
     std::ifstream ifs(SCORE_FILE);
     if (ifs) { int x; while (ifs >> x) v.push_back(x); }
     return v;
 }
 
 void saveHighScore(int newScore) {
+    if (headless) return;
     if (newScore > highScore) {
         highScore = newScore;
         std::ofstream ofs("highscore.txt");
-        if (ofs) ofs << highScore;
+        if (ofs) {
+            ofs << highScore;
+            metricAdd(M_DISK_WRITES);
+        }
     }
 }
 
@@ -422,16 +1471,32 @@ void openHelpFile() {
     if (ofs) {
         ofs.seekp(0, std::ios::end);
         if (ofs.tellp() == 0) {
-            ofs << "DxBall Simple - Help\n\nControls:\n- Move paddle: Mouse or A/D or Left/Right arrows\n- Launch ball: Space\n- Shoot: Left Mouse Click\n- Pause: P\n\nPerks:\n- Extra life, Wider paddle, Speed up ball, Fireball\n- BEWARE: Shrink paddle, Instant Death\n";
+            metricAdd(M_DISK_WRITES);
+            ofs << "DxBall Simple - Help\n\nControls:\n- Move paddle: Mouse or A/D or Left/Right arrows\n- Launch ball: Space\n- Shoot: Left Mouse Click\n- Pause: P\n- Rewind: B (back) / N (forward)\n\nPerks:\n- Extra life, Wider paddle, Speed up ball, Fireball\n- BEWARE: Shrink paddle, Instant Death\n";
         }
     }
     system("start notepad help.txt");
 }
 
+// PlaySound has no tempo control, so "faster" music is a second, faster mix
+// of the track (music-fast.wav) swapped in while it is wanted. Whether that
+// mix exists is checked once at startup; without it the music never changes,
+// since re-playing music.wav would only restart it from the top.
+bool musicFast = false;
+bool haveFastMusic = false;
+
+void probeMusic() {
+    haveFastMusic = GetFileAttributesA("music-fast.wav") != INVALID_FILE_ATTRIBUTES;
+}
+
+const char* musicTrack() {
+    return musicFast ? "music-fast.wav" : "music.wav";
+}
+
 void playMusic() {
     stopMusic();
     if (GetFileAttributesA("music.wav") != INVALID_FILE_ATTRIBUTES) {
-        PlaySoundA("music.wav", NULL, SND_ASYNC | SND_FILENAME | SND_LOOP);
+        PlaySoundA(musicTrack(), NULL, SND_ASYNC | SND_FILENAME | SND_LOOP);
         musicPlaying = true;
     } else {
         std::cerr << "music.wav not found\n";
@@ -443,124 +1508,998 @@ void stopMusic() {
     musicPlaying = false;
 }
 
+void setMusicFast(bool fast) {
+    if (!haveFastMusic || fast == musicFast) return;
+    musicFast = fast;
+    if (musicPlaying) PlaySoundA(musicTrack(), NULL, SND_ASYNC | SND_FILENAME | SND_LOOP);
+}
+
 // =======================================================
-// Part 12: Rendering
-// Details: All UI and scene rendering functions.
+// Part 12: World Snapshots & Time Travel
+// Details: Flat world images, XOR/RLE deltas and the rewind ring buffer.
 // =======================================================
 
-void drawHUD() {
-    std::ostringstream ss; glColor3f(1,1,1);
-    ss << "Score: " << score; drawText(10, WIN_H - 24, ss.str());
-    ss.str(""); ss.clear(); ss << "Lives: " << lives; drawText(10, WIN_H - 48, ss.str());
-    ss.str(""); ss.clear(); ss << "Level: " << currentLevel; drawText(WIN_W - 120, WIN_H - 24, ss.str());
-    ss.str(""); ss.clear(); ss << "Time: " << std::fixed << std::setprecision(1) << elapsedTime; drawText(WIN_W - 140, WIN_H - 48, ss.str());
+// Byte buffers are vectors of uint8_t under whichever allocator tags them.
+template <typename Buf, typename T> void putPod(Buf &out, const T &v) {
+    const uint8_t* p = (const uint8_t*)&v;
+    out.insert(out.end(), p, p + sizeof(T));
+}
+template <typename Buf, typename T> void putColumn(Buf &out, const AlignedVec<T> &col) {
+    const uint8_t* p = (const uint8_t*)col.data();
+    out.insert(out.end(), p, p + col.size() * sizeof(T));
 }
 
-void renderBricks() {
-    for (auto &b : bricks) {
-        if (!b.alive) continue;
-        if (b.hits == 2) {
-            glColor3f(0.75f, 0.75f, 0.75f); // Silver for tough bricks
-        } else {
-            glColor3f(0.2f, 0.5f, 1.0f); // Blue for normal bricks
-        }
-        drawRect(b.x, b.y, b.w, b.h);
+struct ByteReader {
+    const uint8_t *p, *end;
+    bool ok;
+    ByteReader(const uint8_t* data, size_t size) : p(data), end(data + size), ok(true) {}
+    bool bytes(void* dst, size_t n) {
+        if (!ok || (size_t)(end - p) < n) { ok = false; return false; }
+        memcpy(dst, p, n); p += n;
+        return true;
+    }
+    template <typename T> bool pod(T &v) { return bytes(&v, sizeof(T)); }
+    template <typename T> bool column(AlignedVec<T> &col, uint32_t n) { col.resize(n); return bytes(col.data(), n * sizeof(T)); }
+};
+
+// Writes every field explicitly (no struct padding), fixed-size fields
+// first, so images of consecutive ticks line up byte for byte.
+template <typename Buf> void serializeWorld(const World &w, Buf &out) {
+    out.clear();
+    const Ball &b = w.ball;
+    putPod(out, b.x); putPod(out, b.y); putPod(out, b.vx); putPod(out, b.vy);
+    putPod(out, b.radius); putPod(out, b.speed); putPod(out, b.fireballTimer);
+    putPod(out, (uint8_t)b.stuck); putPod(out, (uint8_t)b.isFireball);
+    const Paddle &pd = w.paddle;
+    putPod(out, pd.x); putPod(out, pd.y); putPod(out, pd.w); putPod(out, pd.h); putPod(out, pd.speed);
+    putPod(out, (int32_t)w.score); putPod(out, (int32_t)w.lives);
+    putPod(out, (int32_t)w.currentLevel); putPod(out, (int32_t)w.bricksRemaining);
+    putPod(out, w.fireCooldown); putPod(out, w.rng.s); putPod(out, (uint8_t)w.outcome);
+    putPod(out, (uint32_t)w.bricks.size());
+    putPod(out, (uint32_t)w.perks.size());
+    putPod(out, (uint32_t)w.projectiles.size());
+
+    putColumn(out, w.bricks.hot);
+    putColumn(out, w.bricks.x); putColumn(out, w.bricks.y);
+    putColumn(out, w.bricks.w); putColumn(out, w.bricks.h);
+    for (const Perk &p : w.perks) {
+        putPod(out, p.x); putPod(out, p.y); putPod(out, p.vy);
+        putPod(out, (uint8_t)p.type); putPod(out, (uint8_t)p.alive);
+    }
+    for (const Projectile &p : w.projectiles) {
+        putPod(out, p.x); putPod(out, p.y); putPod(out, p.vy); putPod(out, (uint8_t)p.alive);
+    }
+    // Scripted levels append their tasks; an unscripted image ends here, so
+    // it is the same as before levels had scripts.
+    const ScriptScheduler &sc = w.scripts;
+    if (sc.count == 0) return;
+    putPod(out, (uint8_t)sc.count); putPod(out, sc.clock); putPod(out, sc.palette);
+    for (int k = 0; k < sc.count; ++k) {
+        const ScriptTask &t = sc.tasks[k];
+        putPod(out, t.script); putPod(out, t.pc); putPod(out, t.waitEvents);
+        putPod(out, t.wakeAt); putPod(out, t.wakeBricks);
     }
 }
 
-void renderPerks() {
-    for (auto &p : perks) {
-        if (!p.alive) continue;
-        if (p.type==0) glColor3f(1.0f,0.8f,0.2f);       // Life
-        else if (p.type==1) glColor3f(0.3f,0.8f,0.3f);  // Wide
-        else if (p.type==2) glColor3f(1.0f,0.5f,0.3f);  // Speed
-        else if (p.type==3) glColor3f(1.0f,0.1f,0.1f);  // Fireball
-        else if (p.type==4) glColor3f(0.5f,0.2f,0.8f);  // Shrink
-        else if (p.type==5) glColor3f(0.1f,0.1f,0.1f);  // Death
-        
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(p.x,p.y);
-        for (int i=0;i<=16;++i) {
-            float a = (float)i/16 * 2.0f*M_PI;
-            glVertex2f(p.x + cosf(a)*10.0f, p.y + sinf(a)*10.0f);
+bool deserializeWorld(World &w, const uint8_t *data, size_t size) {
+    ByteReader r(data, size);
+    uint8_t stuck = 0, fireball = 0, outcome = 0;
+    int32_t score = 0, lives = 0, level = 0, remaining = 0;
+    uint32_t nBricks = 0, nPerks = 0, nProj = 0;
+    Ball &b = w.ball;
+    r.pod(b.x); r.pod(b.y); r.pod(b.vx); r.pod(b.vy);
+    r.pod(b.radius); r.pod(b.speed); r.pod(b.fireballTimer);
+    r.pod(stuck); r.pod(fireball);
+    Paddle &pd = w.paddle;
+    r.pod(pd.x); r.pod(pd.y); r.pod(pd.w); r.pod(pd.h); r.pod(pd.speed);
+    r.pod(score); r.pod(lives); r.pod(level); r.pod(remaining);
+    r.pod(w.fireCooldown); r.pod(w.rng.s); r.pod(outcome);
+    r.pod(nBricks); r.pod(nPerks); r.pod(nProj);
+    if (!r.ok) return false;
+    b.stuck = stuck != 0; b.isFireball = fireball != 0;
+    w.score = score; w.lives = lives; w.currentLevel = level; w.bricksRemaining = remaining;
+    w.outcome = (WorldOutcome)outcome;
+
+    BrickStore &bs = w.bricks;
+    r.column(bs.hot, nBricks);
+    r.column(bs.x, nBricks); r.column(bs.y, nBricks);
+    r.column(bs.w, nBricks); r.column(bs.h, nBricks);
+    bs.live.clear();
+    for (uint32_t i = 0; i < nBricks && r.ok; ++i) if (bs.hot[i].alive) bs.live.push_back((int)i);
+    bs.liveDirty = false;
+    bs.dirty.reset(true);
+    if (r.ok) bs.fitGrid();
+
+    w.perks.resize(nPerks);
+    for (Perk &p : w.perks) {
+        uint8_t type = 0, alive = 0;
+        r.pod(p.x); r.pod(p.y); r.pod(p.vy); r.pod(type); r.pod(alive);
+        p.type = type; p.alive = alive != 0;
+    }
+    w.projectiles.resize(nProj);
+    for (Projectile &p : w.projectiles) {
+        uint8_t alive = 0;
+        r.pod(p.x); r.pod(p.y); r.pod(p.vy); r.pod(alive);
+        p.alive = alive != 0;
+    }
+    ScriptScheduler &sc = w.scripts;
+    sc = ScriptScheduler();
+    if (r.ok && r.p < r.end) {
+        uint8_t count = 0;
+        r.pod(count); r.pod(sc.clock); r.pod(sc.palette);
+        if (count > MAX_LEVEL_SCRIPTS) return false;
+        for (int k = 0; k < count; ++k) {
+            ScriptTask &t = sc.tasks[k];
+            r.pod(t.script); r.pod(t.pc); r.pod(t.waitEvents);
+            r.pod(t.wakeAt); r.pod(t.wakeBricks);
+            if (t.script >= LS_COUNT) return false;
         }
-        glEnd();
+        sc.count = count;
+        rescheduleScripts(sc);
     }
+    return r.ok;
 }
 
-void renderProjectiles() {
-    glColor3f(1.0f, 1.0f, 0.2f);
-    for (const auto &p : projectiles) {
-        if (p.alive) drawRect(p.x - 2, p.y, 4, 12);
-    }
+template <typename Buf> void putVarint(Buf &out, uint32_t v) {
+    while (v >= 0x80) { out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+    out.push_back((uint8_t)v);
 }
 
-void renderMenu() {
-    glColor3f(1,1,1);
-    drawText(WIN_W/2 - 100, WIN_H - 150, "DX-BALL SIMPLE");
-    drawText(WIN_W/2 - 100, WIN_H - 220, "1. Play Game");
-    drawText(WIN_W/2 - 100, WIN_H - 250, "2. High Scores");
-    drawText(WIN_W/2 - 100, WIN_H - 280, "3. Music Options");
-    drawText(WIN_W/2 - 100, WIN_H - 310, "4. Help");
-    drawText(WIN_W/2 - 100, WIN_H - 340, "ESC. Exit");
+// Returns false if the varint runs past 'end' (p is left unchanged then).
+bool readVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v) {
+    const uint8_t* q = p;
+    v = 0;
+    for (int shift = 0; q < end && shift < 35; shift += 7) {
+        uint8_t c = *q++;
+        v |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) { p = q; return true; }
+    }
+    return false;
 }
 
-void renderHelp() {
-    glColor3f(1,1,1);
-    drawText(60, WIN_H - 60, "HELP");
-    drawText(60, WIN_H - 100, "- Move: Mouse or A/D or Left/Right");
-    drawText(60, WIN_H - 130, "- Launch ball: Space");
-    drawText(60, WIN_H - 160, "- Shoot: Left Mouse Click");
-    drawText(60, WIN_H - 190, "- Pause: P");
-    drawText(60, 40, "Press ESC to return");
+uint32_t getVarint(const uint8_t *&p, const uint8_t *end) {
+    uint32_t v = 0;
+    if (!readVarint(p, end, v)) p = end;
+    return v;
 }
 
-void renderScoreboard() {
-    glColor3f(1,1,1);
-    drawText(WIN_W/2 - 90, WIN_H - 60, "High Score");
-    std::ostringstream hs_ss; hs_ss << highScore;
-    drawText(WIN_W/2 - 40, WIN_H - 90, hs_ss.str());
+// Delta of 'cur' against 'prev': the XOR of the two images stored as
+// alternating (zero run, literal run) pairs. Unchanged bricks are zero
+// runs, so a quiet tick costs a few bytes.
+template <typename Prev, typename Cur, typename Out> void encodeDelta(const Prev &prev, const Cur &cur, Out &out) {
+    out.clear();
+    putVarint(out, (uint32_t)cur.size());
+    size_t n = cur.size(), i = 0;
+    auto x = [&](size_t k) -> uint8_t { return cur[k] ^ (k < prev.size() ? prev[k] : 0); };
+    while (i < n) {
+        size_t z = i;
+        while (z < n && x(z) == 0) ++z;
+        size_t lit = z;
+        // A literal run ends at the next pair of zero bytes.
+        while (lit < n && !(x(lit) == 0 && lit + 1 < n && x(lit + 1) == 0)) ++lit;
+        putVarint(out, (uint32_t)(z - i));
+        putVarint(out, (uint32_t)(lit - z));
+        for (size_t k = z; k < lit; ++k) out.push_back(x(k));
+        i = lit;
+    }
+}
 
-    drawText(WIN_W/2 - 90, WIN_H - 140, "Recent Scores");
-    auto scores = loadRecentScores();
-    if (scores.empty()) {
-        drawText(WIN_W/2 - 140, WIN_H - 170, "No scores yet!");
-    } else {
-        for (size_t i = 0; i < scores.size(); ++i) {
-            std::ostringstream ss; ss << (i+1) << ". " << scores[i];
-            drawText(WIN_W/2 - 40, WIN_H - 170 - (int)i*30, ss.str());
-        }
+template <typename Prev, typename Delta, typename Out> void decodeDelta(const Prev &prev, const Delta &delta, Out &out) {
+    const uint8_t *p = delta.data(), *end = p + delta.size();
+    uint32_t size = getVarint(p, end);
+    out.resize(size);
+    for (uint32_t k = 0; k < size; ++k) out[k] = k < prev.size() ? prev[k] : 0;
+    uint32_t i = 0;
+    while (p < end && i < size) {
+        i += getVarint(p, end);
+        uint32_t lit = getVarint(p, end);
+        for (uint32_t k = 0; k < lit && i < size && p < end; ++k) out[i++] ^= *p++;
     }
-    drawText(WIN_W/2 - 180, 40, "Press ESC to return");
 }
 
-void renderScene() {
-    glClear(GL_COLOR_BUFFER_BIT); // No depth buffer needed for 2D
-    glMatrixMode(GL_PROJECTION); glLoadIdentity();
-    glOrtho(0, WIN_W, 0, WIN_H, -1, 1);
-    glMatrixMode(GL_MODELVIEW); glLoadIdentity();
+// Last ~30 s of ticks at the 60 Hz timer. Every TT_KEYFRAME_EVERY-th slot
+// holds a full image; the rest are deltas against the tick before. Keyframes
+// stay on fixed slots and every slot is reserved up front, so steady-state
+// capture does not allocate.
+const int TT_TICKS = 30 * 60;
+const int TT_KEYFRAME_EVERY = 300;
+const size_t TT_KEYFRAME_RESERVE = 8192; // Full 8-row field plus entity capacity
+const size_t TT_DELTA_RESERVE = 256;
 
-    if (gameState == GS_MENU) renderMenu();
-    else if (gameState == GS_PLAYING || gameState == GS_PAUSED || gameState == GS_LEVEL_CLEAR || gameState == GS_GAMEOVER) {
-        renderBricks();
-        renderPerks();
-        renderProjectiles();
-        glColor3f(0.9f,0.9f,0.9f); drawRect(paddle.x, paddle.y, paddle.w, paddle.h);
-        
-        if (ball.isFireball) glColor3f(1.0f, 0.8f, 0.2f);
-        else glColor3f(1.0f,0.4f,0.2f);
-        
+typedef TaggedVec<uint8_t, MEM_REWIND> RewindBytes;
+
+struct TimeTravelEntry {
+    bool keyframe;
+    RewindBytes data;
+};
+
+struct TimeTravel {
+    std::vector<TimeTravelEntry> ring;
+    int head = 0;            // Slot the next capture goes into
+    int count = 0;           // Valid entries, newest at head-1
+    int cursor = 0;          // Ticks back from the newest entry while scrubbing
+    RewindBytes prevImage, image, scratch;
+} timeTravel;
+
+void resetTimeTravel() {
+    timeTravel.head = timeTravel.count = timeTravel.cursor = 0;
+}
+
+void captureTimeTravel(const World &w) {
+    TimeTravel &tt = timeTravel;
+    if (tt.ring.empty()) {
+        tt.ring.resize(TT_TICKS);
+        for (int i = 0; i < TT_TICKS; ++i)
+            tt.ring[i].data.reserve(i % TT_KEYFRAME_EVERY == 0 ? TT_KEYFRAME_RESERVE : TT_DELTA_RESERVE);
+        tt.prevImage.reserve(TT_KEYFRAME_RESERVE);
+        tt.image.reserve(TT_KEYFRAME_RESERVE);
+    }
+    serializeWorld(w, tt.image);
+    TimeTravelEntry &e = tt.ring[tt.head];
+    e.keyframe = tt.count == 0 || tt.head % TT_KEYFRAME_EVERY == 0;
+    if (e.keyframe) e.data.assign(tt.image.begin(), tt.image.end());
+    else encodeDelta(tt.prevImage, tt.image, e.data);
+    std::swap(tt.prevImage, tt.image);
+    tt.head = (tt.head + 1) % TT_TICKS;
+    if (tt.count < TT_TICKS) tt.count++;
+}
+
+int timeTravelSlot(int back) {
+    return ((timeTravel.head - 1 - back) % TT_TICKS + TT_TICKS) % TT_TICKS;
+}
+
+// Furthest we can go back: the oldest entry still preceded by a keyframe.
+int timeTravelMaxBack() {
+    for (int back = timeTravel.count - 1; back >= 0; --back)
+        if (timeTravel.ring[timeTravelSlot(back)].keyframe) return back;
+    return 0;
+}
+
+// Rebuilds the image 'back' ticks before the newest into timeTravel.image.
+bool reconstructTimeTravel(int back) {
+    TimeTravel &tt = timeTravel;
+    int key = back;
+    while (key < tt.count && !tt.ring[timeTravelSlot(key)].keyframe) ++key;
+    if (key >= tt.count) return false;
+    tt.image = tt.ring[timeTravelSlot(key)].data;
+    for (int k = key - 1; k >= back; --k) {
+        decodeDelta(tt.image, tt.ring[timeTravelSlot(k)].data, tt.scratch);
+        std::swap(tt.image, tt.scratch);
+    }
+    return true;
+}
+
+// Moves the rewind cursor by 'ticks' (positive = further into the past) and
+// shows the world as it was at that point.
+void scrubTimeTravel(int ticks) {
+    TimeTravel &tt = timeTravel;
+    if (tt.count == 0) return;
+    abandonReplayRecording();
+    int target = std::max(0, std::min(tt.cursor + ticks, timeTravelMaxBack()));
+    if (!reconstructTimeTravel(target)) return;
+    deserializeWorld(world, tt.image.data(), tt.image.size());
+    syncScriptMusic(world);
+    tt.cursor = target;
+}
+
+// Drops everything newer than the cursor so play continues from there.
+void resumeFromTimeTravel() {
+    TimeTravel &tt = timeTravel;
+    if (tt.cursor == 0) return;
+    rewindGhost(tt.cursor);
+    tt.head = timeTravelSlot(tt.cursor - 1);
+    tt.count -= tt.cursor;
+    tt.prevImage = tt.image;
+    tt.cursor = 0;
+}
+
+// =======================================================
+// Part 13: Rendering
+// Details: All UI and scene rendering functions.
+// =======================================================
+
+// Quality governor: holds per-frame work (tick + publish + render submit)
+// under a budget by stepping through QUALITY_LEVELS. It drops a level after
+// the smoothed cost stays above the high mark for a short run of frames and
+// only climbs back after a much longer run below the low mark, so it does
+// not oscillate at the boundary. --quality N pins a level.
+struct QualityLevel {
+    int ballSegments, perkSegments;
+    float renderScale;       // Playfield resolution; the HUD stays full size
+};
+const QualityLevel QUALITY_LEVELS[] = {
+    { 20, 16, 1.0f },
+    { 16, 12, 1.0f },
+    { 12, 8,  0.75f },
+    { 8,  6,  0.5f },
+};
+const int QUALITY_COUNT = sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]);
+const double QUALITY_HIGH_MS = 10.0, QUALITY_LOW_MS = 4.0;
+const int QUALITY_DOWN_FRAMES = 30, QUALITY_UP_FRAMES = 300;
+
+struct QualityGovernor {
+    int level = 0;
+    bool pinned = false;
+    double avgMs = 0.0;
+    int overFrames = 0, underFrames = 0;
+    double lastRenderMs = 0.0;
+    GLuint texture = 0;
+    int textureSize = 0;
+} quality;
+
+const QualityLevel &currentQuality() { return QUALITY_LEVELS[quality.level]; }
+
+void setQualityLevel(int level, const char* why) {
+    QualityGovernor &q = quality;
+    std::cerr << "quality: level " << q.level << " -> " << level << " (" << why << ", avg "
+              << std::fixed << std::setprecision(2) << q.avgMs << " ms)\n";
+    q.level = level;
+    q.overFrames = q.underFrames = 0;
+}
+
+// Called once per played frame with that frame's work in milliseconds.
+void governQuality(double workMs) {
+    QualityGovernor &q = quality;
+    if (q.pinned) return;
+    q.avgMs += (workMs - q.avgMs) * 0.1;
+    if (q.avgMs > QUALITY_HIGH_MS) {
+        q.underFrames = 0;
+        if (++q.overFrames >= QUALITY_DOWN_FRAMES && q.level + 1 < QUALITY_COUNT) setQualityLevel(q.level + 1, "over budget");
+    } else if (q.avgMs < QUALITY_LOW_MS) {
+        q.overFrames = 0;
+        if (++q.underFrames >= QUALITY_UP_FRAMES && q.level > 0) setQualityLevel(q.level - 1, "headroom");
+    } else {
+        q.overFrames = q.underFrames = 0;
+    }
+}
+
+// Reduced resolution: the playfield is drawn into a corner of the back buffer,
+// copied into a texture and stretched back over the window.
+bool beginScaledPlayfield() {
+    float scale = currentQuality().renderScale;
+    if (scale >= 1.0f) return false;
+    int vw = (int)(glutGet(GLUT_WINDOW_WIDTH) * scale), vh = (int)(glutGet(GLUT_WINDOW_HEIGHT) * scale);
+    glViewport(0, 0, vw, vh);
+    return true;
+}
+
+void endScaledPlayfield() {
+    QualityGovernor &q = quality;
+    int ww = glutGet(GLUT_WINDOW_WIDTH), wh = glutGet(GLUT_WINDOW_HEIGHT);
+    float scale = currentQuality().renderScale;
+    int vw = (int)(ww * scale), vh = (int)(wh * scale);
+    int need = 64;
+    while (need < std::max(vw, vh)) need *= 2;
+    if (!q.texture) glGenTextures(1, &q.texture);
+    glBindTexture(GL_TEXTURE_2D, q.texture);
+    if (q.textureSize < need) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, need, need, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        q.textureSize = need;
+    }
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, vw, vh);
+    glViewport(0, 0, ww, wh);
+    glClear(GL_COLOR_BUFFER_BIT);
+    float u = (float)vw / q.textureSize, v = (float)vh / q.textureSize;
+    glEnable(GL_TEXTURE_2D);
+    glColor3f(1, 1, 1);
+    glBegin(GL_QUADS);
+      glTexCoord2f(0, 0); glVertex2f(0, 0);
+      glTexCoord2f(u, 0); glVertex2f(WIN_W, 0);
+      glTexCoord2f(u, v); glVertex2f(WIN_W, WIN_H);
+      glTexCoord2f(0, v); glVertex2f(0, WIN_H);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+}
+
+void drawHUD() {
+    glColor3f(1,1,1);
+    drawText(10, WIN_H - 24, frameText("Score: %d", world.score));
+    drawText(10, WIN_H - 48, frameText("Lives: %d", world.lives));
+    drawText(WIN_W - 120, WIN_H - 24, frameText("Level: %d", world.currentLevel));
+    drawText(WIN_W - 140, WIN_H - 48, frameText("Time: %.1f", elapsedTime));
+    if (ghostRacing()) {
+        int lead = world.score - ghostWorld().score;
+        glColor3f(0.7f, 0.7f, 0.9f);
+        drawText(WIN_W - 140, WIN_H - 72, frameText("Ghost: %d", ghostWorld().score));
+        drawText(WIN_W - 140, WIN_H - 96, frameText("%s%d", lead >= 0 ? "+" : "", lead));
+    }
+}
+
+// Entry points past GL 1.1 are fetched at run time (opengl32 only exports
+// 1.1). The 2.0 set backs the brick field; the 3.3 set (VAOs, buffers,
+// instancing) backs the shape renderer. --legacy-gl skips both.
+bool legacyGl = false;
+
+struct GlEntryPoints {
+    bool loaded = false, shaders = false, instancing = false;
+    PFNGLCREATESHADERPROC createShader;
+    PFNGLSHADERSOURCEPROC shaderSource;
+    PFNGLCOMPILESHADERPROC compileShader;
+    PFNGLGETSHADERIVPROC getShaderiv;
+    PFNGLGETSHADERINFOLOGPROC getShaderInfoLog;
+    PFNGLCREATEPROGRAMPROC createProgram;
+    PFNGLATTACHSHADERPROC attachShader;
+    PFNGLLINKPROGRAMPROC linkProgram;
+    PFNGLGETPROGRAMIVPROC getProgramiv;
+    PFNGLUSEPROGRAMPROC useProgram;
+    PFNGLGETUNIFORMLOCATIONPROC getUniformLocation;
+    PFNGLUNIFORM1IPROC uniform1i;
+    PFNGLUNIFORM1FPROC uniform1f;
+    PFNGLUNIFORM2FPROC uniform2f;
+    PFNGLGENVERTEXARRAYSPROC genVertexArrays;
+    PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+    PFNGLGENBUFFERSPROC genBuffers;
+    PFNGLBINDBUFFERPROC bindBuffer;
+    PFNGLBUFFERDATAPROC bufferData;
+    PFNGLBUFFERSUBDATAPROC bufferSubData;
+    PFNGLVERTEXATTRIBPOINTERPROC vertexAttribPointer;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC enableVertexAttribArray;
+    PFNGLVERTEXATTRIBDIVISORPROC vertexAttribDivisor;
+    PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced;
+} gl;
+
+template <typename F> bool loadGl(F &fn, const char* name) {
+    fn = (F)wglGetProcAddress(name);
+    return fn != nullptr;
+}
+
+bool glVersionAtLeast(int major, int minor) {
+    const char* v = (const char*)glGetString(GL_VERSION);
+    int ma = 0, mi = 0;
+    if (!v || sscanf(v, "%d.%d", &ma, &mi) != 2) return false;
+    return ma > major || (ma == major && mi >= minor);
+}
+
+void loadGlEntryPoints() {
+    if (gl.loaded) return;
+    gl.loaded = true;
+    if (legacyGl) return;
+    gl.shaders = glVersionAtLeast(2, 0) &&
+        loadGl(gl.createShader, "glCreateShader") && loadGl(gl.shaderSource, "glShaderSource") &&
+        loadGl(gl.compileShader, "glCompileShader") && loadGl(gl.getShaderiv, "glGetShaderiv") &&
+        loadGl(gl.getShaderInfoLog, "glGetShaderInfoLog") && loadGl(gl.createProgram, "glCreateProgram") &&
+        loadGl(gl.attachShader, "glAttachShader") && loadGl(gl.linkProgram, "glLinkProgram") &&
+        loadGl(gl.getProgramiv, "glGetProgramiv") && loadGl(gl.useProgram, "glUseProgram") &&
+        loadGl(gl.getUniformLocation, "glGetUniformLocation") && loadGl(gl.uniform1i, "glUniform1i") &&
+        loadGl(gl.uniform1f, "glUniform1f") && loadGl(gl.uniform2f, "glUniform2f");
+    gl.instancing = gl.shaders && glVersionAtLeast(3, 3) &&
+        loadGl(gl.genVertexArrays, "glGenVertexArrays") && loadGl(gl.bindVertexArray, "glBindVertexArray") &&
+        loadGl(gl.genBuffers, "glGenBuffers") && loadGl(gl.bindBuffer, "glBindBuffer") &&
+        loadGl(gl.bufferData, "glBufferData") && loadGl(gl.bufferSubData, "glBufferSubData") &&
+        loadGl(gl.vertexAttribPointer, "glVertexAttribPointer") &&
+        loadGl(gl.enableVertexAttribArray, "glEnableVertexAttribArray") &&
+        loadGl(gl.vertexAttribDivisor, "glVertexAttribDivisor") &&
+        loadGl(gl.drawArraysInstanced, "glDrawArraysInstanced");
+}
+
+// Compiles and links a program. vs may be null for a fragment-only program
+// that rides on fixed-function vertex processing. Returns 0 on failure.
+GLuint buildProgram(const char* what, const char* vs, const char* fs) {
+    const char* src[2] = { vs, fs };
+    const GLenum kind[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    char log[512];
+    GLint status = 0;
+    GLuint program = gl.createProgram();
+    for (int k = 0; k < 2; ++k) {
+        if (!src[k]) continue;
+        GLuint sh = gl.createShader(kind[k]);
+        gl.shaderSource(sh, 1, &src[k], NULL);
+        gl.compileShader(sh);
+        gl.getShaderiv(sh, GL_COMPILE_STATUS, &status);
+        if (!status) {
+            gl.getShaderInfoLog(sh, sizeof(log), NULL, log);
+            std::cerr << what << ": shader failed to compile: " << log << "\n";
+            return 0;
+        }
+        gl.attachShader(program, sh);
+    }
+    gl.linkProgram(program);
+    gl.getProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) { std::cerr << what << ": program failed to link\n"; return 0; }
+    return program;
+}
+
+const float BRICK_CORNER = 4.0f, PADDLE_CORNER = 5.0f;
+
+// Lattice layouts are drawn as one quad: the hot column is uploaded as an
+// RGBA texture (one texel per brick: alive, hits, type, pad) and a fragment
+// shader cuts each cell into a rounded, anti-aliased brick and its gap, with
+// the same box SDF as the shape renderer. Cells are centred on their bricks
+// so the fringe never crosses into a neighbour. Only texels that changed
+// since the last frame, as recorded in the store's dirty list, are re-sent,
+// so an idle frame costs nothing however big the field is. Needs GL 2.0
+// (Mesa's software rasteriser is enough); otherwise, or for irregular
+// layouts, bricks are drawn one quad at a time.
+const char* BRICK_FIELD_SHADER =
+    "uniform sampler2D field;\n"
+    "uniform vec2 gridSize;\n"   // cols, rows
+    "uniform vec2 pitch;\n"      // Cell size in pixels
+    "uniform vec2 halfSize;\n"   // Brick half extents in pixels
+    "uniform float cornerRadius;\n"
+    "uniform float flipRows;\n"  // 1 when row 0 is the top row
+    "uniform float swapColours;\n"
+    "void main() {\n"
+    "    vec2 cell = floor(gl_TexCoord[0].xy);\n"
+    "    vec2 q = abs((gl_TexCoord[0].xy - cell - 0.5) * pitch) - halfSize + cornerRadius;\n"
+    "    float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - cornerRadius;\n"
+    "    float alpha = clamp(0.5 - d / max(fwidth(d), 1e-4), 0.0, 1.0);\n"
+    "    if (alpha <= 0.0) discard;\n"
+    "    float row = flipRows > 0.5 ? gridSize.y - 1.0 - cell.y : cell.y;\n"
+    "    vec4 b = texture2D(field, (vec2(cell.x, row) + 0.5) / gridSize) * 255.0;\n"
+    "    if (b.r < 0.5) discard;\n"
+    "    vec3 c = (b.g > 1.5) ^^ (swapColours > 0.5) ? vec3(0.75, 0.75, 0.75) : vec3(0.2, 0.5, 1.0);\n"
+    "    gl_FragColor = vec4(c, alpha);\n"
+    "}\n";
+
+struct BrickFieldRenderer {
+    bool tried = false, ok = false;
+    GLuint program = 0, texture = 0;
+    GLint locField = -1, locGridSize = -1, locPitch = -1, locHalfSize = -1, locCorner = -1, locFlip = -1, locSwap = -1;
+    int cols = 0, rows = 0;
+} brickField;
+
+bool initBrickField() {
+    BrickFieldRenderer &bf = brickField;
+    if (bf.tried) return bf.ok;
+    bf.tried = true;
+    loadGlEntryPoints();
+    if (!gl.shaders) {
+        if (!legacyGl) std::cerr << "bricks: GL 2.0 not available, drawing per-brick quads\n";
+        return false;
+    }
+    bf.program = buildProgram("bricks", NULL, BRICK_FIELD_SHADER);
+    if (!bf.program) return false;
+    bf.locField = gl.getUniformLocation(bf.program, "field");
+    bf.locGridSize = gl.getUniformLocation(bf.program, "gridSize");
+    bf.locPitch = gl.getUniformLocation(bf.program, "pitch");
+    bf.locHalfSize = gl.getUniformLocation(bf.program, "halfSize");
+    bf.locCorner = gl.getUniformLocation(bf.program, "cornerRadius");
+    bf.locFlip = gl.getUniformLocation(bf.program, "flipRows");
+    bf.locSwap = gl.getUniformLocation(bf.program, "swapColours");
+
+    glGenTextures(1, &bf.texture);
+    glBindTexture(GL_TEXTURE_2D, bf.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    bf.ok = true;
+    return true;
+}
+
+// Brings the texture in line with the hot column. A new lattice shape or a
+// store marked all-dirty (new level, rewind, restore, spectator frame) is a
+// full upload; otherwise only the texels the store recorded as changed (or,
+// past a handful, the rows spanning them) go through glTexSubImage2D.
+void syncBrickTexture(const BrickStore &bs) {
+    BrickFieldRenderer &bf = brickField;
+    const BrickGrid &g = bs.grid;
+    BrickDirty &d = bs.dirty;
+    const BrickHot *cur = bs.hot.data();
+    glBindTexture(GL_TEXTURE_2D, bf.texture);
+    if (d.all || g.cols != bf.cols || g.rows != bf.rows) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, g.cols, g.rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, cur);
+        bf.cols = g.cols; bf.rows = g.rows;
+    } else if (d.count <= BRICK_TEXEL_UPDATES) {
+        for (int k = 0; k < d.count; ++k)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, d.index[k] % g.cols, d.index[k] / g.cols, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &cur[d.index[k]]);
+    } else {
+        int firstRow = d.lo / g.cols, lastRow = d.hi / g.cols;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, g.cols, lastRow - firstRow + 1, GL_RGBA, GL_UNSIGNED_BYTE, &cur[firstRow * g.cols]);
+    }
+    d.reset(false);
+}
+
+void drawBrickField(const BrickStore &bs, bool swapColours) {
+    BrickFieldRenderer &bf = brickField;
+    const BrickGrid &g = bs.grid;
+    syncBrickTexture(bs);
+    float pitchY = fabsf(g.pitchY);
+    // Each cell is the brick plus half the gap on every side.
+    float x0 = g.x - (g.pitchX - g.w) / 2, x1 = x0 + g.cols * g.pitchX;
+    float y0 = (g.pitchY > 0 ? g.y - (g.rows - 1) * g.pitchY : g.y) - (pitchY - g.h) / 2; // Bottom row
+    float y1 = y0 + g.rows * pitchY;
+    gl.useProgram(bf.program);
+    gl.uniform1i(bf.locField, 0);
+    gl.uniform2f(bf.locGridSize, (float)g.cols, (float)g.rows);
+    gl.uniform2f(bf.locPitch, g.pitchX, pitchY);
+    gl.uniform2f(bf.locHalfSize, g.w / 2, g.h / 2);
+    gl.uniform1f(bf.locCorner, std::min(BRICK_CORNER, std::min(g.w, g.h) / 2));
+    gl.uniform1f(bf.locFlip, g.pitchY > 0 ? 1.0f : 0.0f);
+    gl.uniform1f(bf.locSwap, swapColours ? 1.0f : 0.0f);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_TEXTURE_2D);
+    glBegin(GL_QUADS);
+      glTexCoord2f(0, 0); glVertex2f(x0, y0);
+      glTexCoord2f((float)g.cols, 0); glVertex2f(x1, y0);
+      glTexCoord2f((float)g.cols, (float)g.rows); glVertex2f(x1, y1);
+      glTexCoord2f(0, (float)g.rows); glVertex2f(x0, y1);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_BLEND);
+    gl.useProgram(0);
+}
+
+void renderBricks(const World &w) {
+    const BrickStore &bricks = w.bricks;
+    if (bricks.grid.cols > 0 && initBrickField()) { drawBrickField(bricks, w.scripts.palette != 0); return; }
+    for (int i : bricks.live) {
+        const BrickHot &b = bricks.hot[i];
+        if (!b.alive) continue;
+        if (brickLooksTough(w, b)) {
+            glColor3f(0.75f, 0.75f, 0.75f); // Silver for tough bricks
+        } else {
+            glColor3f(0.2f, 0.5f, 1.0f); // Blue for normal bricks
+        }
+        drawRect(bricks.x[i], bricks.y[i], bricks.w[i], bricks.h[i]);
+    }
+}
+
+const float PERK_COLORS[][3] = {
+    { 1.0f, 0.8f, 0.2f },  // Life
+    { 0.3f, 0.8f, 0.3f },  // Wide
+    { 1.0f, 0.5f, 0.3f },  // Speed
+    { 1.0f, 0.1f, 0.1f },  // Fireball
+    { 0.5f, 0.2f, 0.8f },  // Shrink
+    { 0.1f, 0.1f, 0.1f },  // Death
+};
+
+const float *perkColor(int type) { return PERK_COLORS[type >= 0 && type < 6 ? type : 5]; }
+
+void renderPerks(const World &w) {
+    const int segments = currentQuality().perkSegments;
+    for (auto &p : w.perks) {
+        if (!p.alive) continue;
+        glColor3fv(perkColor(p.type));
+        
         glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(ball.x, ball.y);
-        for (int i=0;i<=20;++i) {
-            float a = (float)i/20 * 2.0f * M_PI;
-            glVertex2f(ball.x + cosf(a)*ball.radius, ball.y + sinf(a)*ball.radius);
+        glVertex2f(p.x,p.y);
+        for (int i=0;i<=segments;++i) {
+            float a = (float)i/segments * 2.0f*M_PI;
+            glVertex2f(p.x + cosf(a)*10.0f, p.y + sinf(a)*10.0f);
         }
         glEnd();
-        drawHUD();
+    }
+}
+
+void renderProjectiles(const World &w) {
+    glColor3f(1.0f, 1.0f, 0.2f);
+    for (const auto &p : w.projectiles) {
+        if (p.alive) drawRect(p.x - 2, p.y, 4, 12);
+    }
+}
+
+// Shape renderer: with GL 3.3 the whole playfield is one instanced draw of a
+// unit quad. Each instance is a rounded box (centre, half extents, corner
+// radius, colour); a circle is a box whose corner radius equals its half
+// extent. The fragment shader evaluates the box's signed distance and uses
+// its screen-space derivative for a one-pixel anti-aliased edge, so nothing
+// is tessellated and the governor's segment counts do not apply. The shaders
+// use only core-profile features; the context itself stays compatibility
+// because the HUD and menus are still fixed-function bitmap text.
+struct ShapeInstance {
+    float cx, cy, hw, hh;   // Centre and half extents
+    float radius;           // Corner radius
+    float r, g, b, a;
+};
+
+const char* SHAPE_VERTEX_SHADER =
+    "#version 330 core\n"
+    "layout(location = 0) in vec2 corner;\n"   // Unit quad, -1..1
+    "layout(location = 1) in vec4 box;\n"
+    "layout(location = 2) in float radius;\n"
+    "layout(location = 3) in vec4 color;\n"
+    "uniform vec2 viewSize;\n"
+    "out vec2 local;\n"
+    "flat out vec2 halfSize;\n"
+    "flat out float cornerRadius;\n"
+    "flat out vec4 shapeColor;\n"
+    "void main() {\n"
+    "    local = corner * (box.zw + 1.0);\n"   // Room for the anti-aliased fringe
+    "    halfSize = box.zw;\n"
+    "    cornerRadius = radius;\n"
+    "    shapeColor = color;\n"
+    "    gl_Position = vec4((box.xy + local) / viewSize * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+const char* SHAPE_FRAGMENT_SHADER =
+    "#version 330 core\n"
+    "in vec2 local;\n"
+    "flat in vec2 halfSize;\n"
+    "flat in float cornerRadius;\n"
+    "flat in vec4 shapeColor;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    vec2 q = abs(local) - halfSize + cornerRadius;\n"
+    "    float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - cornerRadius;\n"
+    "    float alpha = clamp(0.5 - d / max(fwidth(d), 1e-4), 0.0, 1.0);\n"
+    "    if (alpha <= 0.0) discard;\n"
+    "    fragColor = vec4(shapeColor.rgb, shapeColor.a * alpha);\n"
+    "}\n";
+
+const float GHOST_ALPHA = 0.35f;
+
+struct ShapeRenderer {
+    bool tried = false, ok = false;
+    GLuint program = 0, vao = 0, quad = 0, instances = 0;
+    GLint locViewSize = -1;
+    size_t capacity = 0;                // Instances the buffer has room for
+    std::vector<ShapeInstance> batch;   // Cleared, not freed, each frame
+} shapes;
+
+bool initShapeRenderer() {
+    ShapeRenderer &sr = shapes;
+    if (sr.tried) return sr.ok;
+    sr.tried = true;
+    loadGlEntryPoints();
+    if (!gl.instancing) {
+        if (!legacyGl) std::cerr << "shapes: GL 3.3 not available, using the fixed-function renderer\n";
+        return false;
+    }
+    sr.program = buildProgram("shapes", SHAPE_VERTEX_SHADER, SHAPE_FRAGMENT_SHADER);
+    if (!sr.program) return false;
+    sr.locViewSize = gl.getUniformLocation(sr.program, "viewSize");
+
+    static const float QUAD[8] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+    gl.genVertexArrays(1, &sr.vao);
+    gl.bindVertexArray(sr.vao);
+    gl.genBuffers(1, &sr.quad);
+    gl.bindBuffer(GL_ARRAY_BUFFER, sr.quad);
+    gl.bufferData(GL_ARRAY_BUFFER, sizeof(QUAD), QUAD, GL_STATIC_DRAW);
+    gl.vertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const void*)0);
+    gl.enableVertexAttribArray(0);
+    gl.genBuffers(1, &sr.instances);
+    gl.bindBuffer(GL_ARRAY_BUFFER, sr.instances);
+    const GLsizei stride = sizeof(ShapeInstance);
+    gl.vertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(ShapeInstance, cx));
+    gl.vertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(ShapeInstance, radius));
+    gl.vertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (const void*)offsetof(ShapeInstance, r));
+    for (GLuint a = 1; a <= 3; ++a) { gl.enableVertexAttribArray(a); gl.vertexAttribDivisor(a, 1); }
+    gl.bindVertexArray(0);
+    gl.bindBuffer(GL_ARRAY_BUFFER, 0);
+    sr.ok = true;
+    return true;
+}
+
+// Placement of a world's playfield on screen: scale, then offset. The main
+// view is the identity; the mosaic gives each tile its own.
+struct TileXform { float ox, oy, scale; };
+const TileXform FULL_VIEW = { 0.0f, 0.0f, 1.0f };
+
+// x, y is the lower-left corner, as with drawRect.
+void addBox(const TileXform &t, float x, float y, float w, float h, float radius, const float *color, float alpha = 1.0f) {
+    float hw = w * 0.5f * t.scale, hh = h * 0.5f * t.scale;
+    ShapeInstance s = { t.ox + x * t.scale + hw, t.oy + y * t.scale + hh, hw, hh, std::min(radius * t.scale, std::min(hw, hh)),
+                        color[0], color[1], color[2], alpha };
+    shapes.batch.push_back(s);
+}
+
+void addCircle(const TileXform &t, float cx, float cy, float radius, const float *color, float alpha = 1.0f) {
+    float r = radius * t.scale;
+    ShapeInstance s = { t.ox + cx * t.scale, t.oy + cy * t.scale, r, r, r, color[0], color[1], color[2], alpha };
+    shapes.batch.push_back(s);
+}
+
+void flushShapes() {
+    ShapeRenderer &sr = shapes;
+    if (sr.batch.empty()) return;
+    gl.bindBuffer(GL_ARRAY_BUFFER, sr.instances);
+    sr.capacity = std::max(sr.capacity, sr.batch.capacity());
+    // Orphan last frame's storage so the upload never waits on the GPU.
+    gl.bufferData(GL_ARRAY_BUFFER, sr.capacity * sizeof(ShapeInstance), NULL, GL_STREAM_DRAW);
+    gl.bufferSubData(GL_ARRAY_BUFFER, 0, sr.batch.size() * sizeof(ShapeInstance), sr.batch.data());
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl.useProgram(sr.program);
+    gl.uniform2f(sr.locViewSize, (float)WIN_W, (float)WIN_H);
+    gl.bindVertexArray(sr.vao);
+    gl.drawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)sr.batch.size());
+    gl.bindVertexArray(0);
+    gl.useProgram(0);
+    gl.bindBuffer(GL_ARRAY_BUFFER, 0);
+    glDisable(GL_BLEND);
+}
+
+// Queues one world's playfield, plus a ghost's ball and paddle under its own.
+// With latticeDrawn the caller has already drawn a lattice field through
+// drawBrickField, so only bricks outside a lattice become instances.
+void queueWorldShapes(const World &w, const TileXform &t, const World *ghostOf = nullptr, bool latticeDrawn = false) {
+    static const float SILVER[3] = { 0.75f, 0.75f, 0.75f }, BLUE[3] = { 0.2f, 0.5f, 1.0f };
+    static const float BOLT[3] = { 1.0f, 1.0f, 0.2f }, PADDLE[3] = { 0.9f, 0.9f, 0.9f };
+    static const float FIREBALL[3] = { 1.0f, 0.8f, 0.2f }, BALL[3] = { 1.0f, 0.4f, 0.2f };
+    {
+        PerfScope ps(PH_RENDER_BRICKS);
+        const BrickStore &bricks = w.bricks;
+        if (!latticeDrawn || bricks.grid.cols == 0)
+        for (int i : bricks.live) {
+            const BrickHot &b = bricks.hot[i];
+            if (b.alive) addBox(t, bricks.x[i], bricks.y[i], bricks.w[i], bricks.h[i], BRICK_CORNER, brickLooksTough(w, b) ? SILVER : BLUE);
+        }
+    }
+    {
+        PerfScope ps(PH_RENDER_PERKS);
+        for (const auto &p : w.perks)
+            if (p.alive) addCircle(t, p.x, p.y, 10.0f, perkColor(p.type));
+    }
+    {
+        PerfScope ps(PH_RENDER_PROJECTILES);
+        for (const auto &p : w.projectiles)
+            if (p.alive) addBox(t, p.x - 2, p.y, 4, 12, 2.0f, BOLT);
+    }
+    const Paddle &paddle = w.paddle;
+    const Ball &ball = w.ball;
+    if (ghostOf) {
+        const World &g = *ghostOf;
+        addBox(t, g.paddle.x, g.paddle.y, g.paddle.w, g.paddle.h, PADDLE_CORNER, PADDLE, GHOST_ALPHA);
+        addCircle(t, g.ball.x, g.ball.y, g.ball.radius, g.ball.isFireball ? FIREBALL : BALL, GHOST_ALPHA);
+    }
+    addBox(t, paddle.x, paddle.y, paddle.w, paddle.h, PADDLE_CORNER, PADDLE);
+    addCircle(t, ball.x, ball.y, ball.radius, ball.isFireball ? FIREBALL : BALL);
+}
+
+// The main view draws a lattice field in one quad from its grid texture,
+// under the instanced shapes; mosaic tiles queue every brick instead.
+void renderShapes() {
+    bool lattice = world.bricks.grid.cols > 0 && initBrickField();
+    if (lattice) { PerfScope ps(PH_RENDER_BRICKS); drawBrickField(world.bricks, world.scripts.palette != 0); }
+    shapes.batch.clear();
+    queueWorldShapes(world, FULL_VIEW, ghostVisible() ? &ghostWorld() : nullptr, lattice);
+    flushShapes();
+}
+
+void renderMenu() {
+    glColor3f(1,1,1);
+    drawText(WIN_W/2 - 100, WIN_H - 150, "DX-BALL SIMPLE");
+    drawText(WIN_W/2 - 100, WIN_H - 220, "1. Play Game");
+    drawText(WIN_W/2 - 100, WIN_H - 250, "2. High Scores");
+    drawText(WIN_W/2 - 100, WIN_H - 280, "3. Music Options");
+    drawText(WIN_W/2 - 100, WIN_H - 310, "4. Help");
+    drawText(WIN_W/2 - 100, WIN_H - 340, frameText("5. Rules: %s", activeRules->name));
+    drawText(WIN_W/2 - 100, WIN_H - 370, "ESC. Exit");
+}
+
+void renderHelp() {
+    glColor3f(1,1,1);
+    drawText(60, WIN_H - 60, "HELP");
+    drawText(60, WIN_H - 100, "- Move: Mouse or A/D or Left/Right");
+    drawText(60, WIN_H - 130, "- Launch ball: Space");
+    drawText(60, WIN_H - 160, "- Shoot: Left Mouse Click");
+    drawText(60, WIN_H - 190, "- Pause: P");
+    drawText(60, WIN_H - 220, "- Rewind: B (back) / N (forward)");
+    drawText(60, 40, "Press ESC to return");
+}
+
+void renderScoreboard() {
+    glColor3f(1,1,1);
+    drawText(WIN_W/2 - 90, WIN_H - 60, "High Score");
+    drawText(WIN_W/2 - 40, WIN_H - 90, frameText("%d", highScore));
+
+    drawText(WIN_W/2 - 90, WIN_H - 140, "Recent Scores");
+    if (recentScoresDirty) { recentScores = loadRecentScores(); recentScoresDirty = false; }
+    if (recentScores.empty()) {
+        drawText(WIN_W/2 - 140, WIN_H - 170, "No scores yet!");
+    } else {
+        for (size_t i = 0; i < recentScores.size(); ++i)
+            drawText(WIN_W/2 - 40, WIN_H - 170 - (int)i*30, frameText("%d. %d", (int)i + 1, recentScores[i]));
+    }
+    drawText(WIN_W/2 - 180, 40, "Press ESC to return");
+}
+
+void renderMusicMenu() {
+    glColor3f(1,1,1);
+    drawText(WIN_W/2 - 80, WIN_H/2 + 40, "Music Options");
+    drawText(WIN_W/2 - 100, WIN_H/2 + 0, "1 - Music ON");
+    drawText(WIN_W/2 - 100, WIN_H/2 - 30, "2 - Music OFF");
+    drawText(WIN_W/2 - 100, WIN_H/2 - 80, "ESC - Back");
+}
+
+// Menu, help, scoreboard and music screens only change on input, so each is
+// recorded into a display list once and replayed until it is invalidated
+// (a different screen, or invalidateStaticScreen after a visible change).
+GLuint staticScreenList = 0;
+GameState staticScreenState = GS_MENU;
+bool staticScreenDirty = true;
+
+bool isStaticScreen(GameState s) {
+    return s == GS_MENU || s == GS_HELP || s == GS_SCOREBOARD || s == GS_MUSIC_MENU;
+}
+
+void invalidateStaticScreen() { staticScreenDirty = true; }
+
+void drawStaticScreen() {
+    if (!staticScreenList) staticScreenList = glGenLists(1);
+    if (staticScreenDirty || staticScreenState != gameState) {
+        glNewList(staticScreenList, GL_COMPILE);
+        if (gameState == GS_MENU) renderMenu();
+        else if (gameState == GS_HELP) renderHelp();
+        else if (gameState == GS_SCOREBOARD) renderScoreboard();
+        else renderMusicMenu();
+        glEndList();
+        staticScreenState = gameState;
+        staticScreenDirty = false;
+    }
+    glCallList(staticScreenList);
+}
+
+// F3: memory per subsystem against its budget; over-budget tags in red.
+void renderProfilerOverlay() {
+    float y = WIN_H - 90;
+    for (int t = 0; t < MEM_TAGS; ++t, y -= 22) {
+        int64_t cur = memAccounts[t].current.load(std::memory_order_relaxed);
+        int64_t peak = memAccounts[t].peak.load(std::memory_order_relaxed);
+        if (memBudget[t] > 0 && cur > memBudget[t]) glColor3f(1.0f, 0.3f, 0.3f);
+        else glColor3f(0.6f, 1.0f, 0.6f);
+        drawText(10, y, frameText("%s %.1f/%.0f KiB (peak %.1f)", MEM_TAG_NAMES[t], cur / 1024.0, memBudget[t] / 1024.0, peak / 1024.0));
+    }
+}
+
+// Ghost ball and paddle, blended over the field (fixed-function path).
+void renderGhost() {
+    const World &g = ghostWorld();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4f(0.9f, 0.9f, 0.9f, GHOST_ALPHA);
+    drawRect(g.paddle.x, g.paddle.y, g.paddle.w, g.paddle.h);
+    glColor4f(1.0f, 0.4f, 0.2f, GHOST_ALPHA);
+    glBegin(GL_TRIANGLE_FAN);
+    glVertex2f(g.ball.x, g.ball.y);
+    const int segments = currentQuality().ballSegments;
+    for (int i = 0; i <= segments; ++i) {
+        float a = (float)i / segments * 2.0f * M_PI;
+        glVertex2f(g.ball.x + cosf(a) * g.ball.radius, g.ball.y + sinf(a) * g.ball.radius);
+    }
+    glEnd();
+    glDisable(GL_BLEND);
+}
+
+// Fixed-function playfield, used when the shape renderer is unavailable.
+void renderPlayfield(const World &w, bool withGhost) {
+    const Ball &ball = w.ball;
+    const Paddle &paddle = w.paddle;
+    { PerfScope ps(PH_RENDER_BRICKS); renderBricks(w); }
+    { PerfScope ps(PH_RENDER_PERKS); renderPerks(w); }
+    { PerfScope ps(PH_RENDER_PROJECTILES); renderProjectiles(w); }
+    if (withGhost && ghostVisible()) renderGhost();
+    glColor3f(0.9f,0.9f,0.9f); drawRect(paddle.x, paddle.y, paddle.w, paddle.h);
+
+    if (ball.isFireball) glColor3f(1.0f, 0.8f, 0.2f);
+    else glColor3f(1.0f,0.4f,0.2f);
+
+    glBegin(GL_TRIANGLE_FAN);
+    glVertex2f(ball.x, ball.y);
+    const int segments = currentQuality().ballSegments;
+    for (int i=0;i<=segments;++i) {
+        float a = (float)i/segments * 2.0f * M_PI;
+        glVertex2f(ball.x + cosf(a)*ball.radius, ball.y + sinf(a)*ball.radius);
+    }
+    glEnd();
+}
+
+void renderScene() {
+    auto renderStart = std::chrono::steady_clock::now();
+    frameArena.reset();
+    glClear(GL_COLOR_BUFFER_BIT); // No depth buffer needed for 2D
+    glMatrixMode(GL_PROJECTION); glLoadIdentity();
+    glOrtho(0, WIN_W, 0, WIN_H, -1, 1);
+    glMatrixMode(GL_MODELVIEW); glLoadIdentity();
+
+    if (isStaticScreen(gameState)) drawStaticScreen();
+    else if (gameState == GS_PLAYING || gameState == GS_PAUSED || gameState == GS_LEVEL_CLEAR || gameState == GS_GAMEOVER) {
+        bool scaled = beginScaledPlayfield();
+        if (initShapeRenderer()) renderShapes();
+        else renderPlayfield(world, true);
+        if (scaled) endScaledPlayfield();
+        { PerfScope ps(PH_RENDER_HUD); drawHUD(); }
 
         if (gameState == GS_PAUSED) {
             glColor3f(1,0.9f,0.2f); drawText(WIN_W/2 - 40, WIN_H/2, "PAUSED");
+            if (timeTravel.cursor > 0) {
+                drawText(WIN_W/2 - 60, WIN_H/2 - 30, frameText("REWIND -%.1fs", timeTravel.cursor / 60.0));
+                drawText(WIN_W/2 - 170, WIN_H/2 - 60, "B/N to scrub, P to resume here");
+            }
         }
         if (gameState == GS_LEVEL_CLEAR) {
             glColor3f(0.9f,0.9f,0.2f); drawText(WIN_W/2 - 70, WIN_H/2 + 20, "LEVEL CLEARED!");
@@ -568,112 +2507,2760 @@ void renderScene() {
         }
         if (gameState == GS_GAMEOVER) {
             glColor3f(1,0.2f,0.2f); drawText(WIN_W/2 - 70, WIN_H/2 + 20, "GAME OVER");
-            std::ostringstream ss; ss << "Score: " << score; drawText(WIN_W/2 - 40, WIN_H/2 - 10, ss.str());
+            drawText(WIN_W/2 - 40, WIN_H/2 - 10, frameText("Score: %d", world.score));
             drawText(WIN_W/2 - 160, WIN_H/2 - 40, "Press SPACE to restart");
         }
-    } else if (gameState == GS_HELP) renderHelp();
-    else if (gameState == GS_SCOREBOARD) renderScoreboard();
-    else if (gameState == GS_MUSIC_MENU) {
-        glColor3f(1,1,1);
-        drawText(WIN_W/2 - 80, WIN_H/2 + 40, "Music Options");
-        drawText(WIN_W/2 - 100, WIN_H/2 + 0, "1 - Music ON");
-        drawText(WIN_W/2 - 100, WIN_H/2 - 30, "2 - Music OFF");
-        drawText(WIN_W/2 - 100, WIN_H/2 - 80, "ESC - Back");
     }
 
+    if (profilerOverlay) renderProfilerOverlay();
+
+    // Timed before the swap: with vsync on, the swap blocks until the next
+    // refresh, and that wait is not render cost the governor can shed.
+    quality.lastRenderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+    recordFlightRenderMs(quality.lastRenderMs);
     glutSwapBuffers();
 }
 
 // =======================================================
-// Part 13: Input Handling
+// Part 14: Input Handling
 // Details: Mouse clicks, mouse movement, and keyboard presses.
 // =======================================================
 
 void mouseClick(int button, int state, int x, int y) {
     if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) return;
     
-    if (gameState == GS_PLAYING) {
-        if (fireCooldown <= 0) {
-            projectiles.push_back({paddle.x + 10, paddle.y + paddle.h, 500.0f, true});
-            projectiles.push_back({paddle.x + paddle.w - 10, paddle.y + paddle.h, 500.0f, true});
-            fireCooldown = FIRE_RATE;
-        }
-    }
+    if (gameState == GS_PLAYING) input.fire = true;
+    wakeFrameLoop();
 }
 
 void passiveMouse(int x, int y) {
     if (gameState == GS_PLAYING) {
-        paddle.x = (float)x - paddle.w*0.5f;
-        if (ball.stuck) ball.x = paddle.x + paddle.w*0.5f;
+        input.mouseMoved = true;
+        input.mouseX = (float)x;
     }
 }
 
 void keyboardDown(unsigned char key, int, int) {
     if (key == 27) { // ESC key
         if (gameState == GS_MENU) exit(0);
-        else gameState = GS_MENU;
+        if (gameInProgress()) saveGameAsync();
+        gameState = GS_MENU;
     } else if (key == ' ' ) {
-        if (gameState == GS_PLAYING && ball.stuck) launchBall();
-        else if (gameState == GS_LEVEL_CLEAR) { currentLevel++; startLevel(currentLevel); }
+        if (gameState == GS_PLAYING) input.launch = true;
+        else if (gameState == GS_LEVEL_CLEAR) startLevel(world.currentLevel + 1);
         else if (gameState == GS_GAMEOVER) startNewGame();
     } else if (key == 'p' || key == 'P') {
-        if (gameState == GS_PLAYING) gameState = GS_PAUSED;
-        else if (gameState == GS_PAUSED) { gameState = GS_PLAYING; gameStartTime = glutGet(GLUT_ELAPSED_TIME) - (int)(elapsedTime*1000.0); }
+        if (gameState == GS_PLAYING) { gameState = GS_PAUSED; saveGameAsync(); }
+        else if (gameState == GS_PAUSED) { resumeFromTimeTravel(); gameState = GS_PLAYING; gameStartTime = glutGet(GLUT_ELAPSED_TIME) - (int)(elapsedTime*1000.0); }
+    } else if (key == 'b' || key == 'B') {
+        if (gameState == GS_PLAYING || gameState == GS_PAUSED) { gameState = GS_PAUSED; scrubTimeTravel(60); }
+    } else if (key == 'n' || key == 'N') {
+        if (gameState == GS_PAUSED) scrubTimeTravel(-60);
     } else if (key == 'r' || key == 'R') {
-        if (gameState == GS_PLAYING || gameState == GS_PAUSED) startLevel(currentLevel);
-    } else if (key == 'a' || key == 'A') keyLeft = true;
-    else if (key == 'd' || key == 'D') keyRight = true;
+        if (gameState == GS_PLAYING || gameState == GS_PAUSED) { resumeFromTimeTravel(); startLevel(world.currentLevel); }
+    } else if (key == 'a' || key == 'A') input.left = true;
+    else if (key == 'd' || key == 'D') input.right = true;
     else if (gameState == GS_MENU) {
         if (key == '1') startNewGame();
         else if (key == '2') gameState = GS_SCOREBOARD;
         else if (key == '3') gameState = GS_MUSIC_MENU;
         else if (key == '4') { openHelpFile(); gameState = GS_HELP; }
+        else if (key == '5') { selectRules((RuleSet)((activeRuleSet + 1) % RULES_COUNT)); invalidateStaticScreen(); }
     } else if (gameState == GS_MUSIC_MENU) {
         if (key == '1') { playMusic(); gameState = GS_MENU; }
         else if (key == '2') { stopMusic(); gameState = GS_MENU; }
     }
+    wakeFrameLoop();
 }
 
 void keyboardUp(unsigned char key, int, int) {
-    if (key == 'a' || key == 'A') keyLeft = false;
-    if (key == 'd' || key == 'D') keyRight = false;
+    if (key == 'a' || key == 'A') input.left = false;
+    if (key == 'd' || key == 'D') input.right = false;
 }
 
 void specialDown(int key, int, int) {
-    if (key == GLUT_KEY_LEFT) keyLeft = true;
-    if (key == GLUT_KEY_RIGHT) keyRight = true;
+    if (key == GLUT_KEY_LEFT) input.left = true;
+    if (key == GLUT_KEY_RIGHT) input.right = true;
+    if (key == GLUT_KEY_F3) { profilerOverlay = !profilerOverlay; wakeFrameLoop(); }
 }
 void specialUp(int key, int, int) {
-    if (key == GLUT_KEY_LEFT) keyLeft = false;
-    if (key == GLUT_KEY_RIGHT) keyRight = false;
+    if (key == GLUT_KEY_LEFT) input.left = false;
+    if (key == GLUT_KEY_RIGHT) input.right = false;
 }
 
 // =======================================================
-// Part 14: Timer Loop
+// Part 15: Timer Loop
 // Details: Computes frame delta, updates game, and schedules redraw.
 // =======================================================
 
+// The timer only free-runs during play. Every other screen is static, so the
+// loop stops there and input wakes it for a single frame (publish + redraw).
+bool frameTimerPending = false;
+bool frameLoopRunning = false;   // The previous frame rescheduled itself
+
+void wakeFrameLoop() {
+    if (frameTimerPending) return;
+    frameTimerPending = true;
+    glutTimerFunc(0, timerFunc, 0);
+}
+
 void timerFunc(int) {
     static int last = 0;
     int now = glutGet(GLUT_ELAPSED_TIME);
-    double dt = (now - last) / 1000.0;
+    // After an idle stretch, the first frame counts as a nominal one so the
+    // wait is not fed to the sim, the frame histogram or the hitch recorder.
+    double frameMs = frameLoopRunning ? now - last : 16.0;
+    double dt = frameMs / 1000.0;
     last = now;
+    frameTimerPending = false;
     if (dt > 0.1) dt = 0.1; // Clamp delta time
 
-    if (gameState == GS_PLAYING) updateGame(dt);
-    
+    auto t0 = std::chrono::steady_clock::now();
+    bool ticked = gameState == GS_PLAYING;
+    if (ticked) { plannerInput(world, input); tickGame(dt); }
+    auto t1 = std::chrono::steady_clock::now();
+    publishSpectators(world);
+    auto t2 = std::chrono::steady_clock::now();
+    double tickMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double workMs = std::chrono::duration<double, std::milli>(t2 - t0).count();
+    publishTelemetry(frameMs, workMs, ticked);
+    observeFrameMs(frameMs);
+    recordFlightFrame(now, frameMs, tickMs, workMs - tickMs, input);
+    if (ticked) governQuality(workMs + quality.lastRenderMs);
+    input.launch = input.fire = input.mouseMoved = false;
+
     glutPostRedisplay();
-    glutTimerFunc(16, timerFunc, 0); // Aim for ~60 FPS
+    frameLoopRunning = gameState == GS_PLAYING;
+    if (frameLoopRunning) {
+        frameTimerPending = true;
+        glutTimerFunc(16, timerFunc, 0); // Aim for ~60 FPS
+    }
 }
 
 // =======================================================
-// Part 15: Main Entry
-// Details: GLUT initialization, setting callbacks, and starting the main loop.
+// Part 16: Spectator Stream
+// Details: Publishes world deltas on a Unix socket and the --spectate viewer.
 // =======================================================
 
-int main(int argc, char** argv) {
+// Wire format, one frame per timer tick:
+//   u8 kind ('K' full image, 'D' delta against the previous frame)
+//   u8 gameState, f32 elapsedTime, varint payload length, payload
+// Payloads are serializeWorld images and encodeDelta deltas.
+const char* SPECTATOR_SOCKET = "dxball-spectate.sock";
+const size_t SPECTATOR_MAX_BACKLOG = 64 * 1024;  // Per viewer, before frames are dropped
+
+typedef TaggedVec<uint8_t, MEM_SPECTATORS> SpectatorBytes;
+
+struct SpectatorClient {
+    SOCKET s;
+    SpectatorBytes out;            // Encoded frames not yet accepted by the socket
+    size_t sent;
+    SpectatorBytes lastImage;
+    bool needKeyframe;
+};
+
+struct SpectatorServer {
+    SOCKET listener = INVALID_SOCKET;
+    std::vector<SpectatorClient> clients;
+    SpectatorBytes image, delta;
+} spectators;
+
+bool initSockets() {
+    static bool done = false;
+    if (!done) { WSADATA wsa; done = WSAStartup(MAKEWORD(2, 2), &wsa) == 0; }
+    return done;
+}
+
+void setNonBlocking(SOCKET s) {
+    unsigned long on = 1;
+    ioctlsocket(s, FIONBIO, &on);
+}
+
+bool startSpectatorServer(const char* path) {
+    if (!initSockets()) return false;
+    SOCKET s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == INVALID_SOCKET) { std::cerr << "spectator: socket() failed\n"; return false; }
+    sockaddr_un addr; memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    DeleteFileA(path);
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR || listen(s, 4) == SOCKET_ERROR) {
+        std::cerr << "spectator: cannot listen on " << path << "\n";
+        closesocket(s);
+        return false;
+    }
+    setNonBlocking(s);
+    spectators.listener = s;
+    return true;
+}
+
+template <typename Buf> void putFrameHeader(Buf &out, char kind, uint32_t len) {
+    out.push_back((uint8_t)kind);
+    out.push_back((uint8_t)gameState);
+    putPod(out, (float)elapsedTime);
+    putVarint(out, len);
+}
+
+// Pushes as much of the client's backlog as the socket takes right now.
+// Returns false if the viewer has gone away.
+bool flushSpectator(SpectatorClient &c) {
+    while (c.sent < c.out.size()) {
+        int n = send(c.s, (const char*)c.out.data() + c.sent, (int)(c.out.size() - c.sent), 0);
+        if (n == SOCKET_ERROR) return WSAGetLastError() == WSAEWOULDBLOCK;
+        c.sent += n;
+    }
+    c.out.clear(); c.sent = 0;
+    return true;
+}
+
+// Called once per timer tick from the game thread. Every socket call is
+// non-blocking; a viewer that cannot keep up has frames dropped and gets a
+// fresh keyframe once its backlog drains.
+void publishSpectators(const World &w) {
+    SpectatorServer &sv = spectators;
+    if (sv.listener == INVALID_SOCKET) return;
+
+    SOCKET s;
+    while ((s = accept(sv.listener, NULL, NULL)) != INVALID_SOCKET) {
+        setNonBlocking(s);
+        SpectatorClient c; c.s = s; c.sent = 0; c.needKeyframe = true;
+        sv.clients.push_back(c);
+    }
+    if (sv.clients.empty()) return;
+
+    serializeWorld(w, sv.image);
+    for (size_t i = 0; i < sv.clients.size(); ) {
+        SpectatorClient &c = sv.clients[i];
+        if (c.out.size() - c.sent > SPECTATOR_MAX_BACKLOG) {
+            c.needKeyframe = true;
+        } else if (c.needKeyframe) {
+            putFrameHeader(c.out, 'K', (uint32_t)sv.image.size());
+            c.out.insert(c.out.end(), sv.image.begin(), sv.image.end());
+            c.lastImage = sv.image;
+            c.needKeyframe = false;
+        } else {
+            encodeDelta(c.lastImage, sv.image, sv.delta);
+            putFrameHeader(c.out, 'D', (uint32_t)sv.delta.size());
+            c.out.insert(c.out.end(), sv.delta.begin(), sv.delta.end());
+            c.lastImage = sv.image;
+        }
+        if (!flushSpectator(c)) {
+            closesocket(c.s);
+            sv.clients.erase(sv.clients.begin() + i);
+        } else ++i;
+    }
+}
+
+// Viewer side: a window that mirrors the publisher using the normal renderer.
+SOCKET spectateSocket = INVALID_SOCKET;
+SpectatorBytes spectateBuf, spectateImage, spectateScratch;
+
+// Applies every complete frame in the receive buffer to 'world'.
+void applySpectatorFrames() {
+    size_t pos = 0;
+    while (spectateBuf.size() - pos >= 6) {
+        const uint8_t* p = spectateBuf.data() + pos + 6;
+        const uint8_t* end = spectateBuf.data() + spectateBuf.size();
+        uint32_t len = 0;
+        if (!readVarint(p, end, len) || (size_t)(end - p) < len) break; // Frame not complete yet
+        uint8_t kind = spectateBuf[pos];
+        SpectatorBytes payload(p, p + len);
+        if (kind == 'K') spectateImage.swap(payload);
+        else { decodeDelta(spectateImage, payload, spectateScratch); spectateImage.swap(spectateScratch); }
+        gameState = (GameState)spectateBuf[pos + 1];
+        float t; memcpy(&t, spectateBuf.data() + pos + 2, sizeof(t));
+        elapsedTime = t;
+        deserializeWorld(world, spectateImage.data(), spectateImage.size());
+        pos = (p - spectateBuf.data()) + len;
+    }
+    spectateBuf.erase(spectateBuf.begin(), spectateBuf.begin() + pos);
+}
+
+void spectateTimer(int) {
+    char buf[16384];
+    int n;
+    while ((n = recv(spectateSocket, buf, sizeof(buf), 0)) > 0) spectateBuf.insert(spectateBuf.end(), buf, buf + n);
+    if (n == 0) exit(0); // Publisher closed the stream
+    int err = n == SOCKET_ERROR ? WSAGetLastError() : 0;
+    if (n == SOCKET_ERROR && err != WSAEWOULDBLOCK) {
+        std::cerr << "spectate: connection lost (error " << err << ")\n";
+        exit(1);
+    }
+    applySpectatorFrames();
+    glutPostRedisplay();
+    glutTimerFunc(16, spectateTimer, 0);
+}
+
+void spectateKeyboard(unsigned char key, int, int) {
+    if (key == 27) exit(0);
+}
+
+int runSpectator(int argc, char** argv, const char* path) {
+    if (!initSockets()) return 1;
+    spectateSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr; memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (spectateSocket == INVALID_SOCKET || connect(spectateSocket, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        std::cerr << "spectate: cannot connect to " << path << "\n";
+        return 1;
+    }
+    setNonBlocking(spectateSocket);
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(WIN_W, WIN_H);
+    glutCreateWindow("DX-Ball Spectator");
+    glClearColor(0.05f, 0.05f, 0.15f, 1.0f);
+    gameState = GS_PAUSED;
+    glutDisplayFunc(renderScene);
+    glutKeyboardFunc(spectateKeyboard);
+    glutTimerFunc(16, spectateTimer, 0);
+    glutMainLoop();
+    return 0;
+}
+
+// =======================================================
+// Part 17: Shared-Memory Telemetry
+// Details: Seqlock metrics block and event ring for external monitors (--telemetry).
+// =======================================================
+
+// Named file mapping (the Windows counterpart of a POSIX shm object). The
+// writer only does plain stores into mapped memory; readers poll it at any
+// rate without the game making a single syscall.
+const char* TELEMETRY_NAME = "Local\\dxball-telemetry";
+const uint32_t TELEMETRY_MAGIC = 0x4D4C4554; // "TELM"
+const uint32_t TELEMETRY_VERSION = 1;
+const int TELEMETRY_EVENTS = 256;
+
+enum TelemetryEventType { EV_LIFE_LOST, EV_LIFE_GAINED, EV_LEVEL_START, EV_LEVEL_CLEAR, EV_GAME_OVER, EV_QUALITY };
+
+struct TelemetryMetrics {
+    uint64_t frame;
+    float frameMs, frameMsAvg, workMs;         // Frame interval, its 1 s mean, tick+publish cost
+    float tickRate, scoreRate;                 // Per second over the last full second
+    float brickHitsPerSec, paddleHitsPerSec, wallHitsPerSec, perksCaughtPerSec;
+    int32_t bricksLive, perksLive, projectilesLive;
+    int32_t score, lives, level, gameState;
+};
+
+struct TelemetryEvent {
+    uint64_t frame;
+    uint32_t type;
+    int32_t value;
+};
+
+struct TelemetryShared {
+    uint32_t magic, version;
+    std::atomic<uint32_t> seq;                 // Odd while the writer is inside 'metrics'
+    TelemetryMetrics metrics;
+    std::atomic<uint64_t> eventHead;           // Total events written; slot = index % TELEMETRY_EVENTS
+    TelemetryEvent events[TELEMETRY_EVENTS];
+};
+
+struct TelemetryWriter {
+    TelemetryShared* shm = nullptr;
+    uint64_t frame = 0;
+    // One-second window for the rates
+    double windowMs = 0.0, windowFrameMs = 0.0;
+    int windowFrames = 0, windowTicks = 0, windowStartScore = 0;
+    WorldCounters windowStart = {};
+    float rates[6] = {};
+    float frameMsAvg = 0.0f;
+    int lastLives = 0, lastLevel = 0, lastQuality = 0;
+} telemetry;
+
+bool startTelemetry() {
+    HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(TelemetryShared), TELEMETRY_NAME);
+    if (!h) { std::cerr << "telemetry: cannot create shared memory\n"; return false; }
+    void* p = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(TelemetryShared));
+    if (!p) { CloseHandle(h); return false; }
+    TelemetryShared* t = new (p) TelemetryShared();
+    t->magic = TELEMETRY_MAGIC;
+    t->version = TELEMETRY_VERSION;
+    telemetry.shm = t;
+    return true;
+}
+
+void telemetryEvent(uint32_t type, int32_t value) {
+    TelemetryShared* t = telemetry.shm;
+    uint64_t h = t->eventHead.load(std::memory_order_relaxed);
+    TelemetryEvent &e = t->events[h % TELEMETRY_EVENTS];
+    e.frame = telemetry.frame; e.type = type; e.value = value;
+    t->eventHead.store(h + 1, std::memory_order_release);
+}
+
+// A new or resumed game sets lives outside play; take that as the baseline
+// so it is not reported as a life gained or lost.
+void resyncTelemetryLives() {
+    telemetry.lastLives = world.lives;
+}
+
+// Called once per timer tick with the measured frame interval and the time
+// spent ticking the game.
+void publishTelemetry(double frameMs, double workMs, bool ticked) {
+    TelemetryWriter &tw = telemetry;
+    TelemetryShared* t = tw.shm;
+    if (!t) return;
+    const World &w = world;
+    tw.frame++;
+
+    if (w.lives < tw.lastLives) telemetryEvent(EV_LIFE_LOST, w.lives);
+    else if (w.lives > tw.lastLives) telemetryEvent(EV_LIFE_GAINED, w.lives);
+    if (w.currentLevel != tw.lastLevel) telemetryEvent(EV_LEVEL_START, w.currentLevel);
+    if (ticked && w.outcome == WO_LEVEL_CLEAR) telemetryEvent(EV_LEVEL_CLEAR, w.currentLevel);
+    if (ticked && w.outcome == WO_GAME_OVER) telemetryEvent(EV_GAME_OVER, w.score);
+    if (quality.level != tw.lastQuality) telemetryEvent(EV_QUALITY, quality.level);
+    tw.lastLives = w.lives; tw.lastLevel = w.currentLevel; tw.lastQuality = quality.level;
+
+    tw.windowMs += frameMs; tw.windowFrameMs += frameMs; tw.windowFrames++;
+    if (ticked) tw.windowTicks++;
+    if (tw.windowMs >= 1000.0) {
+        float secs = (float)(tw.windowMs / 1000.0);
+        const WorldCounters &c = w.counters, &s = tw.windowStart;
+        tw.rates[0] = tw.windowTicks / secs;
+        tw.rates[1] = (w.score - tw.windowStartScore) / secs;
+        tw.rates[2] = (c.brickHits - s.brickHits) / secs;
+        tw.rates[3] = (c.paddleHits - s.paddleHits) / secs;
+        tw.rates[4] = (c.wallHits - s.wallHits) / secs;
+        tw.rates[5] = (c.perksCaught - s.perksCaught) / secs;
+        tw.frameMsAvg = (float)(tw.windowFrameMs / tw.windowFrames);
+        tw.windowStart = c; tw.windowStartScore = w.score;
+        tw.windowMs = tw.windowFrameMs = 0.0;
+        tw.windowFrames = tw.windowTicks = 0;
+    }
+
+    uint32_t seq = t->seq.load(std::memory_order_relaxed);
+    t->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    TelemetryMetrics &m = t->metrics;
+    m.frame = tw.frame;
+    m.frameMs = (float)frameMs;
+    m.workMs = (float)workMs;
+    m.frameMsAvg = tw.frameMsAvg;
+    m.tickRate = tw.rates[0]; m.scoreRate = tw.rates[1];
+    m.brickHitsPerSec = tw.rates[2]; m.paddleHitsPerSec = tw.rates[3];
+    m.wallHitsPerSec = tw.rates[4]; m.perksCaughtPerSec = tw.rates[5];
+    m.bricksLive = (int32_t)w.bricks.live.size();
+    m.perksLive = 0;
+    for (const Perk &p : w.perks) m.perksLive += p.alive;
+    m.projectilesLive = 0;
+    for (const Projectile &p : w.projectiles) m.projectilesLive += p.alive;
+    m.score = w.score; m.lives = w.lives; m.level = w.currentLevel; m.gameState = gameState;
+    t->seq.store(seq + 2, std::memory_order_release);
+}
+
+// Reader CLI: samples the block every 'intervalMs' and prints new events.
+int runTelemetryReader(int intervalMs) {
+    HANDLE h = OpenFileMappingA(FILE_MAP_READ, FALSE, TELEMETRY_NAME);
+    if (!h) { std::cerr << "telemetry: game is not running with --telemetry\n"; return 1; }
+    const TelemetryShared* t = (const TelemetryShared*)MapViewOfFile(h, FILE_MAP_READ, 0, 0, sizeof(TelemetryShared));
+    if (!t || t->magic != TELEMETRY_MAGIC || t->version != TELEMETRY_VERSION) { std::cerr << "telemetry: bad block\n"; return 1; }
+    static const char* EVENT_NAMES[] = { "life-lost", "life-gained", "level-start", "level-clear", "game-over", "quality" };
+
+    uint64_t nextEvent = t->eventHead.load(std::memory_order_acquire);
+    for (;;) {
+        TelemetryMetrics m;
+        for (;;) {
+            uint32_t s1 = t->seq.load(std::memory_order_acquire);
+            if (s1 & 1) continue;
+            memcpy(&m, (const void*)&t->metrics, sizeof(m));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (t->seq.load(std::memory_order_relaxed) == s1) break;
+        }
+        std::cout << std::fixed << std::setprecision(2)
+                  << "frame=" << m.frame << " frame_ms=" << m.frameMs << " frame_ms_avg=" << m.frameMsAvg
+                  << " work_ms=" << m.workMs << " tick_hz=" << m.tickRate << " score_per_s=" << m.scoreRate
+                  << " brick_hits_per_s=" << m.brickHitsPerSec << " paddle_hits_per_s=" << m.paddleHitsPerSec
+                  << " wall_hits_per_s=" << m.wallHitsPerSec << " perks_caught_per_s=" << m.perksCaughtPerSec
+                  << " bricks=" << m.bricksLive << " perks=" << m.perksLive << " projectiles=" << m.projectilesLive
+                  << " score=" << m.score << " lives=" << m.lives << " level=" << m.level << "\n";
+
+        uint64_t head = t->eventHead.load(std::memory_order_acquire);
+        if (head - nextEvent > (uint64_t)TELEMETRY_EVENTS) {
+            std::cout << "event ring overrun, skipped " << head - nextEvent - TELEMETRY_EVENTS << "\n";
+            nextEvent = head - TELEMETRY_EVENTS;
+        }
+        for (; nextEvent < head; ++nextEvent) {
+            TelemetryEvent e = t->events[nextEvent % TELEMETRY_EVENTS];
+            // The writer may have lapped us while we copied.
+            if (t->eventHead.load(std::memory_order_acquire) - nextEvent > (uint64_t)TELEMETRY_EVENTS) continue;
+            std::cout << "event frame=" << e.frame << " " << (e.type <= EV_QUALITY ? EVENT_NAMES[e.type] : "?") << " value=" << e.value << "\n";
+        }
+        std::cout.flush();
+        Sleep(intervalMs);
+    }
+}
+
+// =======================================================
+// Part 18: Headless Benchmarks
+// Details: Fixed-step runs of the simulation without a window (--bench).
+// =======================================================
+
+// Keeps the ball in play: steers the paddle under the ball and launches it.
+void autopilot(const World &w, InputFrame &in) {
+    float centre = w.paddle.x + w.paddle.w * 0.5f;
+    in.left = w.ball.x < centre - w.paddle.w * 0.25f;
+    in.right = w.ball.x > centre + w.paddle.w * 0.25f;
+    in.launch = w.ball.stuck;
+}
+
+// Plays 'ticks' fixed steps through 'step' from the same seed and returns the
+// mean simulation cost per tick in nanoseconds. With 'capture' set, the
+// time-travel capture is timed instead of the step.
+double benchLoop(UpdateFn step, int ticks, unsigned seed, bool capture = false) {
+    srand(seed);
+    startNewGame();
+    const double dt = 1.0 / 120.0;
+    double total = 0.0;
+    InputFrame in = {};
+    for (int i = 0; i < ticks; ++i) {
+        autopilot(world, in);
+        auto t0 = std::chrono::steady_clock::now();
+        step(world, in, dt);
+        auto t1 = std::chrono::steady_clock::now();
+        if (capture) {
+            captureTimeTravel(world);
+            t0 = t1; t1 = std::chrono::steady_clock::now();
+        }
+        total += std::chrono::duration<double, std::nano>(t1 - t0).count();
+        if (world.outcome == WO_LEVEL_CLEAR) startLevel(world.currentLevel + 1);
+        else if (world.outcome == WO_GAME_OVER) startNewGame();
+    }
+    return total / ticks;
+}
+
+int runBenchmark() {
+    headless = true;
+    const int ticks = 200000;
+    benchLoop(updateGame<ClassicRules>, ticks / 4, 1u); // Warm-up
+    std::cout << "rules      specialised ns/tick   runtime ns/tick\n";
+    for (int rs = 0; rs < RULES_COUNT; ++rs) {
+        selectRules((RuleSet)rs);
+        double fast = benchLoop(updateGameFn, ticks, 1234u);
+        double slow = benchLoop(updateGame<RuntimeRules>, ticks, 1234u);
+        std::cout << std::left << std::setw(11) << RULE_PARAMS[rs].name
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(20) << fast << std::setw(18) << slow << "\n";
+    }
+    selectRules(RULES_CLASSIC);
+
+    double capture = benchLoop(updateGameFn, ticks, 1234u, true);
+    size_t bytes = 0;
+    for (const TimeTravelEntry &e : timeTravel.ring) bytes += e.data.capacity();
+    std::cout << "time-travel capture: " << std::fixed << std::setprecision(1) << capture
+              << " ns/tick, ring " << bytes / 1024 << " KiB\n";
+
+    // Profiled pass: per-phase cost with whatever counters the OS exposes.
+    initPerfCounters();
+    benchLoop(updateGameFn, ticks, 1234u);
+    perfEnabled = false;
+    printPerfReport(std::cout);
+    printMemReport(std::cout);
+    return 0;
+}
+
+// --alloc-check: plays frames through the same per-frame work as the live
+// loop (replay recording, step, ghost race, rewind capture, spectators,
+// metrics, flight recorder) and fails if any steady-state frame touches the
+// heap. The session is recorded in memory and races a bot ghost, as under
+// --record and --ghost. With --windowed each frame is also rendered (shape
+// batch or brick field, quality copy, HUD). Level transitions and the frame
+// after are excluded: they rebuild the field, start the prefetch worker and
+// record a full-field rewind delta.
+int runAllocCheck(int ticks, bool windowed, int argc, char** argv) {
+    headless = true;
+    const double dt = 1.0 / 60.0;
+    const int warmup = TT_TICKS * 2; // Until every rewind slot has held a keyframe-sized image
+    if (windowed) {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+        glutInitWindowSize(WIN_W, WIN_H);
+        glutCreateWindow("DX-Ball Alloc Check");
+        glClearColor(0.05f, 0.05f, 0.15f, 1.0f);
+    }
+    raceBotGhost(1234u, warmup + ticks);
+    srand(1234u);
+    startNewGame();
+    InputFrame in = {};
+    uint64_t worst = 0, allocating = 0;
+    bool transition = false;
+    for (int i = 0; i < warmup + ticks; ++i) {
+        autopilot(world, in);
+        in.fire = i % 20 == 0;
+        uint64_t before = threadAllocs;
+        recordReplayTick(dt, in);
+        updateGameFn(world, in, dt);
+        stepGhost();
+        captureTimeTravel(world);
+        publishSpectators(world);
+        observeFrameMs(dt * 1000.0);
+        recordFlightFrame(i * 16, dt * 1000.0, 0.0, 0.0, in);
+        if (windowed) renderScene();
+        uint64_t n = threadAllocs - before;
+        if (i >= warmup && !transition && n > 0) { allocating++; worst = std::max(worst, n); }
+        transition = world.outcome != WO_NONE;
+        if (world.outcome == WO_LEVEL_CLEAR) startLevel(world.currentLevel + 1);
+        else if (world.outcome == WO_GAME_OVER) startNewGame();
+    }
+    std::cout << "alloc-check: " << allocating << " of " << ticks << " frames allocated (worst " << worst << ")\n";
+    return allocating == 0 ? 0 : 1;
+}
+
+bool initPerfCounters() {
+    memset(perfStats, 0, sizeof(perfStats));
+    ULONG64 cycles = 0;
+    perfAvailable[PC_CYCLES] = QueryThreadCycleTime(GetCurrentThread(), &cycles) != 0;
+    perfEnabled = true;
+    return perfAvailable[PC_CYCLES];
+}
+
+void printPerfReport(std::ostream &os) {
+    static const char* PHASE_NAMES[PHASE_COUNT] = {
+        "input", "move", "walls", "paddle", "bricks", "perks", "projectiles", "compact", "speed",
+        "render.bricks", "render.perks", "render.projectiles", "render.hud"
+    };
+    static const char* COUNTER_NAMES[PERF_COUNTERS] = { "cycles", "instructions", "l1-misses", "llc-misses", "branch-misses" };
+    os << "phase counters:";
+    for (int c = 0; c < PERF_COUNTERS; ++c) os << " " << COUNTER_NAMES[c] << (perfAvailable[c] ? "" : "(n/a)");
+    os << "\n";
+    os << std::left << std::setw(20) << "phase" << std::right << std::setw(10) << "calls" << std::setw(12) << "ns/call"
+       << std::setw(14) << "cycles/call" << std::setw(8) << "IPC" << std::setw(12) << "L1 miss%"
+       << std::setw(12) << "LLC miss%" << std::setw(12) << "br miss%" << "\n";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        const PerfPhaseStats &st = perfStats[p];
+        if (st.calls == 0) continue;
+        const uint64_t *c = st.counters;
+        os << std::left << std::setw(20) << PHASE_NAMES[p] << std::right << std::fixed << std::setprecision(1)
+           << std::setw(10) << st.calls << std::setw(12) << st.ns / st.calls;
+        if (perfAvailable[PC_CYCLES]) os << std::setw(14) << (double)c[PC_CYCLES] / st.calls; else os << std::setw(14) << "n/a";
+        // Ratios need instructions as well as the numerator.
+        bool ins = perfAvailable[PC_INSTRUCTIONS] && c[PC_INSTRUCTIONS] > 0;
+        if (ins && perfAvailable[PC_CYCLES] && c[PC_CYCLES] > 0) os << std::setprecision(2) << std::setw(8) << (double)c[PC_INSTRUCTIONS] / c[PC_CYCLES];
+        else os << std::setw(8) << "n/a";
+        const int misses[3] = { PC_L1_MISSES, PC_LLC_MISSES, PC_BRANCH_MISSES };
+        for (int m : misses) {
+            if (ins && perfAvailable[m]) os << std::setprecision(3) << std::setw(12) << 100.0 * c[m] / c[PC_INSTRUCTIONS];
+            else os << std::setw(12) << "n/a";
+        }
+        os << "\n";
+    }
+}
+
+void printPerfReportAtExit() {
+    printPerfReport(std::cout);
+}
+
+void printMemReport(std::ostream &os) {
+    os << std::left << std::setw(14) << "memory" << std::right << std::setw(12) << "current KiB"
+       << std::setw(10) << "peak KiB" << std::setw(12) << "budget KiB" << "\n" << std::fixed << std::setprecision(1);
+    for (int t = 0; t < MEM_TAGS; ++t) {
+        int64_t peak = memAccounts[t].peak.load();
+        os << std::left << std::setw(14) << MEM_TAG_NAMES[t] << std::right
+           << std::setw(12) << memAccounts[t].current.load() / 1024.0 << std::setw(10) << peak / 1024.0
+           << std::setw(12) << memBudget[t] / 1024.0
+           << (memBudget[t] > 0 && peak > memBudget[t] ? "  OVER BUDGET" : "") << "\n";
+    }
+}
+
+// --mem-budget tag=KiB[,tag=KiB...], e.g. "rewind=256,spectators=128".
+bool parseMemBudgets(const char* spec) {
+    std::istringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t eq = item.find('=');
+        int t = 0;
+        while (t < MEM_TAGS && (eq == std::string::npos || item.compare(0, eq, MEM_TAG_NAMES[t]) != 0)) ++t;
+        if (t == MEM_TAGS) { std::cerr << "mem-budget: unknown entry " << item << "\n"; return false; }
+        memBudget[t] = (int64_t)(atof(item.c_str() + eq + 1) * 1024);
+    }
+    return true;
+}
+
+// =======================================================
+// Part 19: Metrics Exporter
+// Details: Sums the counter shards and writes a Prometheus textfile (--metrics).
+// =======================================================
+
+const double FRAME_MS_BUCKETS[FRAME_BUCKETS] = { 4, 8, 16.7, 33.3, 50, 100, 250 };
+
+void observeFrameMs(double ms) {
+    int b = 0;
+    while (b < FRAME_BUCKETS && ms > FRAME_MS_BUCKETS[b]) ++b;
+    metricAdd(M_FRAME_BUCKET_0 + b);
+    metricAdd(M_FRAME_COUNT);
+    metricAdd(M_FRAME_SUM_US, (uint64_t)(ms * 1000.0));
+}
+
+uint64_t metricTotal(int id) {
+    uint64_t sum = 0;
+    for (int s = 0; s < METRIC_SHARDS; ++s) sum += metricShards[s].v[id].load(std::memory_order_relaxed);
+    return sum;
+}
+
+struct MetricsExporter {
+    std::string path;
+    std::thread worker;
+    std::mutex mu;
+    std::condition_variable cv;
+    bool stop = false;
+    std::chrono::steady_clock::time_point started;
+} metricsExporter;
+
+const int METRICS_FLUSH_SECONDS = 15;
+
+void writeMetricsFile() {
+    MetricsExporter &me = metricsExporter;
+    std::ostringstream ss;
+    ss << "# HELP dxball_up Whether the game process is running.\n# TYPE dxball_up gauge\ndxball_up 1\n";
+    ss << "# HELP dxball_uptime_seconds Seconds since the exporter started.\n# TYPE dxball_uptime_seconds gauge\n"
+       << "dxball_uptime_seconds " << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - me.started).count() << "\n";
+    struct Simple { int id; const char *name, *help; };
+    const Simple simple[] = {
+        { M_BRICKS_DESTROYED, "dxball_bricks_destroyed_total", "Bricks destroyed by the ball or projectiles." },
+        { M_BALLS_LOST, "dxball_balls_lost_total", "Balls that fell past the paddle." },
+        { M_PROJECTILES_FIRED, "dxball_projectiles_fired_total", "Projectiles fired from the paddle." },
+        { M_DISK_WRITES, "dxball_disk_writes_total", "Score, high score and help file writes." },
+    };
+    for (const Simple &c : simple)
+        ss << "# HELP " << c.name << " " << c.help << "\n# TYPE " << c.name << " counter\n" << c.name << " " << metricTotal(c.id) << "\n";
+    ss << "# HELP dxball_perks_spawned_total Perks dropped, by type.\n# TYPE dxball_perks_spawned_total counter\n";
+    for (int t = 0; t < PERK_TYPES; ++t)
+        ss << "dxball_perks_spawned_total{type=\"" << PERK_NAMES[t] << "\"} " << metricTotal(M_PERK_SPAWNED_0 + t) << "\n";
+    ss << "# HELP dxball_perks_caught_total Perks caught by the paddle, by type.\n# TYPE dxball_perks_caught_total counter\n";
+    for (int t = 0; t < PERK_TYPES; ++t)
+        ss << "dxball_perks_caught_total{type=\"" << PERK_NAMES[t] << "\"} " << metricTotal(M_PERK_CAUGHT_0 + t) << "\n";
+
+    ss << "# HELP dxball_frame_time_seconds Interval between timer ticks.\n# TYPE dxball_frame_time_seconds histogram\n";
+    uint64_t cumulative = 0;
+    for (int b = 0; b < FRAME_BUCKETS; ++b) {
+        cumulative += metricTotal(M_FRAME_BUCKET_0 + b);
+        ss << "dxball_frame_time_seconds_bucket{le=\"" << FRAME_MS_BUCKETS[b] / 1000.0 << "\"} " << cumulative << "\n";
+    }
+    cumulative += metricTotal(M_FRAME_BUCKET_0 + FRAME_BUCKETS);
+    ss << "dxball_frame_time_seconds_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    ss << "dxball_frame_time_seconds_sum " << std::fixed << std::setprecision(6) << metricTotal(M_FRAME_SUM_US) / 1e6 << "\n";
+    ss << "dxball_frame_time_seconds_count " << metricTotal(M_FRAME_COUNT) << "\n";
+
+    // Write then rename, so the node exporter never reads a half-written file.
+    std::string tmp = me.path + ".tmp";
+    {
+        std::ofstream ofs(tmp.c_str(), std::ios::trunc);
+        if (!ofs) return;
+        ofs << ss.str();
+    }
+    MoveFileExA(tmp.c_str(), me.path.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+void metricsExporterLoop() {
+    MetricsExporter &me = metricsExporter;
+    std::unique_lock<std::mutex> lock(me.mu);
+    while (!me.stop) {
+        me.cv.wait_for(lock, std::chrono::seconds(METRICS_FLUSH_SECONDS));
+        lock.unlock();
+        writeMetricsFile();
+        lock.lock();
+    }
+}
+
+void stopMetricsExporter() {
+    MetricsExporter &me = metricsExporter;
+    if (!me.worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(me.mu);
+        me.stop = true;
+    }
+    me.cv.notify_one();
+    me.worker.join();
+}
+
+void startMetricsExporter(const char* path) {
+    MetricsExporter &me = metricsExporter;
+    me.path = path;
+    me.started = std::chrono::steady_clock::now();
+    me.worker = std::thread(metricsExporterLoop);
+    atexit(stopMetricsExporter); // exit() is how ESC quits
+}
+
+// =======================================================
+// Part 20: Hitch Flight Recorder
+// Details: Always-on ring of recent frames, dumped to disk when a frame is slow.
+// =======================================================
+
+const int FLIGHT_FRAMES = 512;
+
+enum FlightInputBits { FI_LEFT = 1, FI_RIGHT = 2, FI_LAUNCH = 4, FI_FIRE = 8, FI_MOUSE = 16 };
+
+struct FlightFrame {
+    uint64_t frame;
+    int32_t timeMs;                         // GLUT clock at frame start
+    float frameMs, tickMs, publishMs, renderMs;
+    uint8_t gameState, inputBits;
+    float mouseX;
+    uint32_t stateHash;
+};
+
+struct FlightDump {
+    uint64_t trigger;
+    float budgetMs;
+    std::vector<FlightFrame> frames;        // Oldest first
+    std::vector<uint8_t> worldImage;
+};
+
+struct FlightRecorder {
+    FlightFrame ring[FLIGHT_FRAMES];
+    uint64_t frame = 0;
+    uint64_t quietUntil = 0;                // No new dump before this frame
+    float budgetMs = 50.0f;
+    // Dumps are written by a background thread so the slow frame does not
+    // also pay for the disk.
+    std::thread writer;
+    std::mutex mu;
+    std::condition_variable cv;
+    std::vector<FlightDump> queue;
+    bool stop = false;
+} flight;
+
+// Cheap fingerprint of the fields that drift first when physics goes wrong;
+// the full image is only serialized for a dump.
+uint32_t quickWorldHash(const World &w) {
+    uint32_t h = 2166136261u;
+    auto mix = [&h](uint32_t v) { h = (h ^ v) * 16777619u; };
+    uint32_t bits[6];
+    memcpy(bits, &w.ball.x, sizeof(float) * 4);   // x, y, vx, vy
+    memcpy(&bits[4], &w.paddle.x, sizeof(float));
+    memcpy(&bits[5], &w.ball.speed, sizeof(float));
+    for (uint32_t b : bits) mix(b);
+    mix((uint32_t)w.score); mix((uint32_t)w.lives); mix((uint32_t)w.bricksRemaining); mix(w.rng.s);
+    return h;
+}
+
+void writeFlightDump(const FlightDump &d) {
+    std::ostringstream name;
+    name << "hitch-" << d.trigger;
+    std::ofstream csv((name.str() + ".csv").c_str(), std::ios::trunc);
+    if (!csv) return;
+    csv << "# trigger_frame=" << d.trigger << " budget_ms=" << d.budgetMs << " world=" << name.str() << ".world\n";
+    csv << "frame,time_ms,frame_ms,tick_ms,publish_ms,render_ms,game_state,input,mouse_x,state_hash\n";
+    csv << std::fixed << std::setprecision(3);
+    for (const FlightFrame &f : d.frames)
+        csv << f.frame << "," << f.timeMs << "," << f.frameMs << "," << f.tickMs << "," << f.publishMs << ","
+            << f.renderMs << "," << (int)f.gameState << "," << (int)f.inputBits << "," << f.mouseX << ","
+            << std::hex << f.stateHash << std::dec << "\n";
+    std::ofstream bin((name.str() + ".world").c_str(), std::ios::binary | std::ios::trunc);
+    if (bin) bin.write((const char*)d.worldImage.data(), d.worldImage.size());
+    metricAdd(M_DISK_WRITES, 2);
+}
+
+void flightWriterLoop() {
+    std::unique_lock<std::mutex> lock(flight.mu);
+    for (;;) {
+        flight.cv.wait(lock, [] { return flight.stop || !flight.queue.empty(); });
+        if (flight.queue.empty()) return;
+        std::vector<FlightDump> batch;
+        batch.swap(flight.queue);
+        lock.unlock();
+        for (const FlightDump &d : batch) writeFlightDump(d);
+        lock.lock();
+    }
+}
+
+void stopFlightRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(flight.mu);
+        flight.stop = true;
+    }
+    flight.cv.notify_one();
+    if (flight.writer.joinable()) flight.writer.join();
+}
+
+void startFlightRecorder(float budgetMs) {
+    flight.budgetMs = budgetMs;
+    flight.writer = std::thread(flightWriterLoop);
+    atexit(stopFlightRecorder);
+}
+
+// Called once per timer tick, before the edges in 'in' are cleared. A normal
+// frame is a handful of stores into the ring.
+void recordFlightFrame(int timeMs, double frameMs, double tickMs, double publishMs, const InputFrame &in) {
+    FlightRecorder &fr = flight;
+    FlightFrame &f = fr.ring[fr.frame % FLIGHT_FRAMES];
+    f.frame = fr.frame;
+    f.timeMs = timeMs;
+    f.frameMs = (float)frameMs; f.tickMs = (float)tickMs; f.publishMs = (float)publishMs; f.renderMs = 0.0f;
+    f.gameState = (uint8_t)gameState;
+    f.inputBits = (in.left ? FI_LEFT : 0) | (in.right ? FI_RIGHT : 0) | (in.launch ? FI_LAUNCH : 0)
+                | (in.fire ? FI_FIRE : 0) | (in.mouseMoved ? FI_MOUSE : 0);
+    f.mouseX = in.mouseX;
+    f.stateHash = quickWorldHash(world);
+    fr.frame++;
+
+    if (frameMs <= fr.budgetMs || fr.frame < fr.quietUntil || !fr.writer.joinable()) return;
+    // Slow frame: snapshot the window and hand it to the writer thread.
+    FlightDump d;
+    d.trigger = f.frame;
+    d.budgetMs = fr.budgetMs;
+    size_t n = (size_t)std::min<uint64_t>(fr.frame, FLIGHT_FRAMES);
+    d.frames.reserve(n);
+    for (uint64_t k = fr.frame - n; k < fr.frame; ++k) d.frames.push_back(fr.ring[k % FLIGHT_FRAMES]);
+    serializeWorld(world, d.worldImage);
+    {
+        std::lock_guard<std::mutex> lock(fr.mu);
+        fr.queue.push_back(std::move(d));
+    }
+    fr.cv.notify_one();
+    fr.quietUntil = fr.frame + FLIGHT_FRAMES / 2;
+}
+
+// Render time lands in the newest record; the display callback runs after
+// the timer tick that asked for the redraw.
+void recordFlightRenderMs(double ms) {
+    if (flight.frame > 0) flight.ring[(flight.frame - 1) % FLIGHT_FRAMES].renderMs = (float)ms;
+}
+
+// =======================================================
+// Part 21: Session Replays & Regression Harness
+// Details: Recording (--record, --record-bot), playback and --regress.
+// =======================================================
+
+// A session is its seed, rule set and every tick's input. Replaying it on a
+// fresh World reproduces the run exactly, so its final hash pins behaviour.
+//   "DXRP" u32 version u32 seed u8 rules u32 recordCount
+//   records: u8 kind; RR_TICK adds u8 dtMs, u8 inputBits, [f32 mouseX if FI_MOUSE]
+//   i32 finalScore u64 finalHash
+const uint32_t REPLAY_VERSION = 1;
+
+enum ReplayRecordKind { RR_TICK, RR_NEXT_LEVEL, RR_RESTART_LEVEL };
+
+struct ReplayRecord {
+    uint8_t kind, dtMs, bits;
+    float mouseX;
+};
+
+struct Replay {
+    uint32_t seed = 0;
+    uint8_t rules = RULES_CLASSIC;
+    TaggedVec<ReplayRecord, MEM_REPLAYS> records;
+    int32_t finalScore = 0;
+    uint64_t finalHash = 0;
+};
+
+// FNV-1a over the serialized image: any drift in any field changes it.
+uint64_t hashWorld(const World &w) {
+    static thread_local std::vector<uint8_t> image;
+    serializeWorld(w, image);
+    uint64_t h = 1469598103934665603ull;
+    for (uint8_t b : image) h = (h ^ b) * 1099511628211ull;
+    return h;
+}
+
+bool saveReplay(const Replay &r, const std::string &path) {
+    TaggedVec<uint8_t, MEM_REPLAYS> out;
+    out.insert(out.end(), { 'D', 'X', 'R', 'P' });
+    putPod(out, REPLAY_VERSION); putPod(out, r.seed); putPod(out, r.rules);
+    putPod(out, (uint32_t)r.records.size());
+    for (const ReplayRecord &rec : r.records) {
+        out.push_back(rec.kind);
+        if (rec.kind != RR_TICK) continue;
+        out.push_back(rec.dtMs); out.push_back(rec.bits);
+        if (rec.bits & FI_MOUSE) putPod(out, rec.mouseX);
+    }
+    putPod(out, r.finalScore); putPod(out, r.finalHash);
+    std::ofstream ofs(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!ofs) return false;
+    ofs.write((const char*)out.data(), out.size());
+    metricAdd(M_DISK_WRITES);
+    return (bool)ofs;
+}
+
+bool loadReplay(const std::string &path, Replay &r) {
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    if (!ifs) return false;
+    TaggedVec<uint8_t, MEM_REPLAYS> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ByteReader rd(data.data(), data.size());
+    char magic[4]; uint32_t version = 0, n = 0;
+    rd.bytes(magic, 4); rd.pod(version);
+    if (!rd.ok || memcmp(magic, "DXRP", 4) != 0 || version != REPLAY_VERSION) return false;
+    rd.pod(r.seed); rd.pod(r.rules); rd.pod(n);
+    if (!rd.ok || r.rules >= RULES_COUNT) return false;
+    r.records.resize(n);
+    for (ReplayRecord &rec : r.records) {
+        rec.dtMs = rec.bits = 0; rec.mouseX = 0.0f;
+        rd.pod(rec.kind);
+        if (rec.kind != RR_TICK) continue;
+        rd.pod(rec.dtMs); rd.pod(rec.bits);
+        if (rec.bits & FI_MOUSE) rd.pod(rec.mouseX);
+    }
+    rd.pod(r.finalScore); rd.pod(r.finalHash);
+    return rd.ok;
+}
+
+InputFrame replayInput(const ReplayRecord &rec) {
+    InputFrame in = {};
+    in.left = (rec.bits & FI_LEFT) != 0; in.right = (rec.bits & FI_RIGHT) != 0;
+    in.launch = (rec.bits & FI_LAUNCH) != 0; in.fire = (rec.bits & FI_FIRE) != 0;
+    in.mouseMoved = (rec.bits & FI_MOUSE) != 0; in.mouseX = rec.mouseX;
+    return in;
+}
+
+ReplayRecord replayTickRecord(int dtMs, const InputFrame &in) {
+    ReplayRecord rec;
+    rec.kind = RR_TICK;
+    rec.dtMs = (uint8_t)dtMs;
+    rec.bits = (in.left ? FI_LEFT : 0) | (in.right ? FI_RIGHT : 0) | (in.launch ? FI_LAUNCH : 0)
+             | (in.fire ? FI_FIRE : 0) | (in.mouseMoved ? FI_MOUSE : 0);
+    rec.mouseX = in.mouseMoved ? in.mouseX : 0.0f;
+    return rec;
+}
+
+// Re-simulates 'r' on 'w' under the rule set already selected. If 'tickNs'
+// is given, each tick's cost is appended to it.
+// Returns false, stopping there, at the first record live play could not
+// have written: anything after a game over, a level change before the level
+// was cleared, or a restart outside play (R only works while playing or
+// paused, so a cleared level can never be restarted and farmed again).
+bool simulateReplay(const Replay &r, World &w, std::vector<double> *tickNs = nullptr) {
+    resetWorld(w, r.seed);
+    for (const ReplayRecord &rec : r.records) {
+        if (w.outcome == WO_GAME_OVER) return false;
+        if (rec.kind == RR_NEXT_LEVEL) {
+            if (w.outcome != WO_LEVEL_CLEAR) return false;
+            beginLevel(w, w.currentLevel + 1);
+            continue;
+        }
+        if (rec.kind == RR_RESTART_LEVEL) {
+            if (w.outcome != WO_NONE) return false;
+            beginLevel(w, w.currentLevel);
+            continue;
+        }
+        InputFrame in = replayInput(rec);
+        if (!tickNs) { updateGameFn(w, in, rec.dtMs / 1000.0); continue; }
+        auto t0 = std::chrono::steady_clock::now();
+        updateGameFn(w, in, rec.dtMs / 1000.0);
+        tickNs->push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+    }
+    return true;
+}
+
+// As simulateReplay, selecting the replay's rule set first.
+bool playReplay(const Replay &r, World &w, std::vector<double> *tickNs = nullptr) {
+    selectRules((RuleSet)r.rules);
+    return simulateReplay(r, w, tickNs);
+}
+
+// Ghost race (--ghost <file>): new games take the best run's seed and rule
+// set, and its recorded inputs are replayed on a second World in lockstep
+// with live play, one recorded tick per live tick. Only the ghost's ball and
+// paddle are drawn, translucent, in the playfield pass; its bricks are never
+// rendered. Its level data is generated from its own rng, because perk drops
+// make the two runs' later layouts diverge, and refills reuse its storage,
+// so a ghost tick is one more allocation-free sim step. A game over that
+// beats the ghost replaces the file and becomes the next ghost. Rewinding
+// hides the ghost while scrubbing and re-simulates it to the resumed tick.
+struct GhostRace {
+    std::string path;
+    Replay replay;
+    bool loaded = false;
+    bool running = false;    // Replaying alongside the current game
+    World w;
+    size_t cursor = 0;       // Next record
+    int ticks = 0;           // Live ticks since the race began
+} ghost;
+
+bool ghostEnabled() { return !ghost.path.empty(); }
+bool ghostRacing() { return ghost.running; }
+const World &ghostWorld() { return ghost.w; }
+
+// Drawn while the ghost is on the player's level and still in play.
+bool ghostVisible() {
+    return ghost.running && timeTravel.cursor == 0 && ghost.w.currentLevel == world.currentLevel && ghost.w.outcome == WO_NONE;
+}
+
+void loadGhost(const char* path) {
+    GhostRace &g = ghost;
+    g.path = path;
+    g.loaded = loadReplay(g.path, g.replay);
+    if (g.loaded) std::cerr << "ghost: racing " << path << " (score " << g.replay.finalScore << ")\n";
+    else std::cerr << "ghost: no run in " << path << " yet; your first game becomes the ghost\n";
+}
+
+// Returns the seed the new game should use.
+uint32_t beginGhostRace(uint32_t seed) {
+    GhostRace &g = ghost;
+    g.running = g.loaded;
+    if (!g.running) return seed;
+    selectRules((RuleSet)g.replay.rules);
+    resetWorld(g.w, g.replay.seed);
+    g.cursor = 0;
+    g.ticks = 0;
+    return g.replay.seed;
+}
+
+void stepGhost() {
+    GhostRace &g = ghost;
+    if (!g.running) return;
+    g.ticks++;
+    const auto &recs = g.replay.records;
+    for (; g.cursor < recs.size(); ++g.cursor) {
+        const ReplayRecord &rec = recs[g.cursor];
+        if (rec.kind == RR_NEXT_LEVEL) beginLevel(g.w, g.w.currentLevel + 1);
+        else if (rec.kind == RR_RESTART_LEVEL) beginLevel(g.w, g.w.currentLevel);
+        else break;
+    }
+    if (g.cursor == recs.size()) return;   // The ghost's run is over
+    const ReplayRecord &rec = recs[g.cursor++];
+    quietSim = true;
+    updateGameFn(g.w, replayInput(rec), rec.dtMs / 1000.0);
+    quietSim = false;
+}
+
+// Live play resumed 'ticks' ticks in the past: replay the ghost from the
+// start up to the same tick so the race stays one recorded tick per live tick.
+void rewindGhost(int ticks) {
+    GhostRace &g = ghost;
+    if (!g.running || ticks <= 0) return;
+    int target = std::max(0, g.ticks - ticks);
+    resetWorld(g.w, g.replay.seed);
+    g.cursor = 0;
+    g.ticks = 0;
+    while (g.ticks < target) stepGhost();
+}
+
+void offerGhostRun(const Replay &r) {
+    GhostRace &g = ghost;
+    if (!ghostEnabled() || (g.loaded && r.finalScore <= g.replay.finalScore)) return;
+    if (!saveReplay(r, g.path)) { std::cerr << "ghost: cannot write " << g.path << "\n"; return; }
+    g.replay = r;
+    g.loaded = true;
+    std::cerr << "ghost: new best " << r.finalScore << " saved to " << g.path << "\n";
+}
+
+// Live recording (--record <file>): the session is written when it ends in
+// a game over. Rewinding abandons it, since the inputs no longer line up.
+// The record buffer is reserved for REPLAY_RESERVE_TICKS once and reused by
+// later games, so recording a tick does not allocate until a single game
+// outlasts it; past that the vector doubles, a handful of times per hour.
+const size_t REPLAY_RESERVE_TICKS = 10 * 60 * 60; // Ten minutes at 60 Hz
+
+struct LiveRecording {
+    std::string path;
+    Replay replay;
+    bool active = false;
+    bool inMemory = false;   // Record with no file or ghost (--alloc-check)
+} liveRecording;
+
+void beginReplayRecording(uint32_t seed) {
+    LiveRecording &lr = liveRecording;
+    if (lr.path.empty() && !ghostEnabled() && !lr.inMemory) return;
+    lr.replay.records.clear();
+    lr.replay.records.reserve(REPLAY_RESERVE_TICKS);
+    lr.replay.seed = seed;
+    lr.replay.rules = (uint8_t)activeRuleSet;
+    lr.replay.finalScore = 0;
+    lr.replay.finalHash = 0;
+    lr.active = true;
+}
+
+void recordReplayTick(double dt, const InputFrame &in) {
+    if (liveRecording.active) liveRecording.replay.records.push_back(replayTickRecord((int)lround(dt * 1000.0), in));
+}
+
+void recordReplayEvent(int kind) {
+    if (!liveRecording.active) return;
+    ReplayRecord rec = {};
+    rec.kind = (uint8_t)kind;
+    liveRecording.replay.records.push_back(rec);
+}
+
+void abandonReplayRecording() {
+    liveRecording.active = false;
+}
+
+void finishReplayRecording(const World &w) {
+    LiveRecording &lr = liveRecording;
+    if (!lr.active) return;
+    lr.active = false;
+    lr.replay.finalScore = w.score;
+    lr.replay.finalHash = hashWorld(w);
+    if (!lr.path.empty() && !saveReplay(lr.replay, lr.path)) std::cerr << "replay: cannot write " << lr.path << "\n";
+    offerGhostRun(lr.replay);
+}
+
+// Plays an autopilot session at a fixed 16 ms step into 'r', under the rule
+// set already selected.
+void recordBotRun(Replay &r, uint32_t seed, int maxTicks) {
+    r.seed = seed; r.rules = (uint8_t)activeRuleSet;
+    r.records.clear();
+    World w;
+    resetWorld(w, seed);
+    InputFrame in = {};
+    for (int t = 0; t < maxTicks && w.outcome != WO_GAME_OVER; ++t) {
+        if (w.outcome == WO_LEVEL_CLEAR) {
+            ReplayRecord rec = {}; rec.kind = RR_NEXT_LEVEL;
+            r.records.push_back(rec);
+            beginLevel(w, w.currentLevel + 1);
+        }
+        autopilot(w, in);
+        in.fire = t % 20 == 0;
+        r.records.push_back(replayTickRecord(16, in));
+        updateGameFn(w, in, 16 / 1000.0);
+    }
+    r.finalScore = w.score;
+    r.finalHash = hashWorld(w);
+}
+
+// --alloc-check's stand-in for --record and --ghost: new games record in
+// memory and race a bot run of 'ticks' ticks on 'seed'.
+void raceBotGhost(uint32_t seed, int ticks) {
+    recordBotRun(ghost.replay, seed, ticks);
+    ghost.loaded = true;
+    liveRecording.inMemory = true;
+}
+
+// --record-bot: records an autopilot session and prints the corpus.txt line
+// for it.
+int recordBotReplay(const char* path, uint32_t seed, int rules, int maxTicks) {
+    headless = true;
+    if (rules < 0 || rules >= RULES_COUNT) return 1;
+    selectRules((RuleSet)rules);
+    Replay r;
+    recordBotRun(r, seed, maxTicks);
+    if (!saveReplay(r, path)) { std::cerr << "replay: cannot write " << path << "\n"; return 1; }
+    std::cout << path << " " << r.finalScore << " " << std::hex << r.finalHash << std::dec << "\n";
+    return 0;
+}
+
+double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)std::ceil(p * v.size());
+    return v[std::min(v.size() - 1, i > 0 ? i - 1 : 0)];
+}
+
+struct RegressResult {
+    std::string name;
+    double p50Ns, p99Ns, ticksPerSec;
+};
+
+// --regress <dir>: replays every session listed in <dir>/corpus.txt
+// ("file score hash" per line), checks its final score and hash, and
+// compares p99 tick time and throughput with <dir>/baseline.txt. Fails if
+// behaviour changed or either number regressed by more than 'threshold'.
+// --write-baseline records the current numbers instead of comparing.
+int runRegression(const std::string &dir, bool writeBaseline, double threshold) {
+    headless = true;
+    const int REPS = 9;
+    std::ifstream corpus((dir + "/corpus.txt").c_str());
+    if (!corpus) { std::cerr << "regress: no " << dir << "/corpus.txt\n"; return 1; }
+
+    std::vector<RegressResult> results;
+    bool ok = true;
+    std::string line;
+    while (std::getline(corpus, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        std::string file; int32_t expectScore = 0; uint64_t expectHash = 0;
+        ls >> file >> expectScore >> std::hex >> expectHash;
+        Replay r;
+        if (!loadReplay(dir + "/" + file, r)) { std::cerr << "regress: cannot load " << file << "\n"; ok = false; continue; }
+
+        // Throughput from untimed runs (median rep), tick percentiles from timed ones.
+        World w;
+        std::vector<double> repSec, tickNs;
+        for (int rep = 0; rep < REPS; ++rep) {
+            auto t0 = std::chrono::steady_clock::now();
+            playReplay(r, w);
+            repSec.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+            playReplay(r, w, &tickNs);
+        }
+        uint64_t hash = hashWorld(w);
+        if (w.score != expectScore || hash != expectHash || w.score != r.finalScore || hash != r.finalHash) {
+            std::cout << "FAIL " << file << ": score " << w.score << " (expected " << expectScore << "), hash "
+                      << std::hex << hash << " (expected " << expectHash << ")" << std::dec << "\n";
+            ok = false;
+        }
+
+        // Second, instrumented pass for the per-phase distribution.
+        initPerfCounters();
+        std::vector<std::vector<double> > phaseNs(PHASE_COUNT);
+        selectRules((RuleSet)r.rules);
+        resetWorld(w, r.seed);
+        for (const ReplayRecord &rec : r.records) {
+            if (rec.kind == RR_NEXT_LEVEL) { beginLevel(w, w.currentLevel + 1); continue; }
+            if (rec.kind == RR_RESTART_LEVEL) { beginLevel(w, w.currentLevel); continue; }
+            double before[PHASE_COUNT];
+            for (int p = 0; p < PHASE_COUNT; ++p) before[p] = perfStats[p].ns;
+            updateGameFn(w, replayInput(rec), rec.dtMs / 1000.0);
+            for (int p = 0; p < PH_RENDER_BRICKS; ++p) phaseNs[p].push_back(perfStats[p].ns - before[p]);
+        }
+        perfEnabled = false;
+
+        RegressResult res;
+        res.name = file;
+        res.p50Ns = percentile(tickNs, 0.50);
+        res.p99Ns = percentile(tickNs, 0.99);
+        double medianSec = percentile(repSec, 0.50);
+        res.ticksPerSec = medianSec > 0 ? tickNs.size() / REPS / medianSec : 0.0;
+        results.push_back(res);
+        std::cout << std::fixed << std::setprecision(1) << file << ": " << tickNs.size() / REPS << " ticks, p50 "
+                  << res.p50Ns << " ns, p99 " << res.p99Ns << " ns, " << std::setprecision(0) << res.ticksPerSec << " ticks/s\n";
+        static const char* PHASES[PH_RENDER_BRICKS] = { "input", "move", "walls", "paddle", "bricks", "perks", "projectiles", "compact", "speed" };
+        std::cout << "  phase p50/p99 ns:";
+        for (int p = 0; p < PH_RENDER_BRICKS; ++p)
+            std::cout << std::setprecision(0) << " " << PHASES[p] << "=" << percentile(phaseNs[p], 0.50) << "/" << percentile(phaseNs[p], 0.99);
+        std::cout << "\n";
+    }
+
+    std::string baselinePath = dir + "/baseline.txt";
+    if (writeBaseline) {
+        std::ofstream ofs(baselinePath.c_str(), std::ios::trunc);
+        ofs << "# file p99_ns ticks_per_sec\n" << std::fixed << std::setprecision(1);
+        for (const RegressResult &res : results) ofs << res.name << " " << res.p99Ns << " " << res.ticksPerSec << "\n";
+        std::cout << "baseline written to " << baselinePath << "\n";
+        return ok ? 0 : 1;
+    }
+
+    std::ifstream base(baselinePath.c_str());
+    if (!base) std::cout << "no baseline at " << baselinePath << ", timing not checked (use --write-baseline)\n";
+    while (base && std::getline(base, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        std::string file; double p99 = 0, tps = 0;
+        ls >> file >> p99 >> tps;
+        for (const RegressResult &res : results) {
+            if (res.name != file) continue;
+            if (res.p99Ns > p99 * (1.0 + threshold)) {
+                std::cout << "FAIL " << file << ": p99 " << res.p99Ns << " ns vs baseline " << p99 << " ns\n";
+                ok = false;
+            }
+            if (res.ticksPerSec < tps * (1.0 - threshold)) {
+                std::cout << "FAIL " << file << ": " << res.ticksPerSec << " ticks/s vs baseline " << tps << "\n";
+                ok = false;
+            }
+        }
+    }
+    std::cout << (ok ? "regress: OK\n" : "regress: FAILED\n");
+    return ok ? 0 : 1;
+}
+
+// Leaderboard verification (--verify <replay.dxr|list.txt>... [--out file]).
+// Each submission is re-simulated from its seed and inputs and accepted only
+// if the recomputed score and final hash match what it claims. Loading and
+// simulation are spread over the --sim-threads workers, which pull
+// submissions off a shared counter. The rule presets are process-wide, so
+// submissions are verified one rule set at a time. Accepted runs go to --out
+// as "rules path score hash", one board per rule set in RuleSet order, best
+// first within each; scores under different rules are never ranked together.
+const int REPLAY_MAX_DT_MS = 100;   // The live loop clamps dt to 0.1 s
+
+struct Verdict {
+    bool accepted = false;
+    int32_t score = 0;
+    uint64_t hash = 0;
+    const char* reason = "unreadable";
+};
+
+struct VerifyBatch {
+    std::vector<std::string> paths;
+    std::vector<Replay> replays;
+    std::vector<Verdict> verdicts;
+    std::vector<size_t> pending;     // Indices for the current pass
+    std::atomic<size_t> next;
+    std::atomic<bool> loaded[RULES_COUNT];
+} verifyBatch;
+
+void verifyLoadStripe(int) {
+    VerifyBatch &vb = verifyBatch;
+    for (size_t k; (k = vb.next.fetch_add(1)) < vb.pending.size(); ) {
+        size_t i = vb.pending[k];
+        if (!loadReplay(vb.paths[i], vb.replays[i])) continue;
+        vb.verdicts[i].reason = nullptr;
+        vb.loaded[vb.replays[i].rules] = true;
+    }
+}
+
+void verifyReplayStripe(int) {
+    VerifyBatch &vb = verifyBatch;
+    World w;
+    quietSim = true;
+    for (size_t k; (k = vb.next.fetch_add(1)) < vb.pending.size(); ) {
+        size_t i = vb.pending[k];
+        const Replay &r = vb.replays[i];
+        Verdict &v = vb.verdicts[i];
+        bool sane = true;
+        for (const ReplayRecord &rec : r.records)
+            if (rec.kind > RR_RESTART_LEVEL || (rec.kind == RR_TICK && rec.dtMs > REPLAY_MAX_DT_MS)) { sane = false; break; }
+        if (!sane) { v.reason = "bad record"; continue; }
+        if (!simulateReplay(r, w)) { v.reason = "impossible record"; continue; }
+        v.score = w.score;
+        v.hash = hashWorld(w);
+        if (v.score != r.finalScore) v.reason = "score mismatch";
+        else if (v.hash != r.finalHash) v.reason = "hash mismatch";
+        else v.accepted = true;
+    }
+    quietSim = false;
+}
+
+// Runs 'job' on every worker over 'pending', one index each until none remain.
+void runVerifyPass(void (*job)(int)) {
+    verifyBatch.next = 0;
+    runStripes(job);
+}
+
+// Arguments ending in 'ext' (.dxr replays by default) are taken as they are;
+// anything else lists one path per line, relative to the list's directory.
+bool collectSubmissions(const char* arg, std::vector<std::string> &paths, const char* ext = ".dxr") {
+    std::string a = arg;
+    size_t n = strlen(ext);
+    if (a.size() > n && a.compare(a.size() - n, n, ext) == 0) { paths.push_back(a); return true; }
+    std::ifstream list(arg);
+    if (!list) return false;
+    size_t slash = a.find_last_of("/\\");
+    std::string dir = slash == std::string::npos ? "" : a.substr(0, slash + 1);
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        paths.push_back(line[0] == '/' ? line : dir + line);
+    }
+    return true;
+}
+
+int runVerifier(int argc, char** argv) {
+    VerifyBatch &vb = verifyBatch;
+    headless = true;
+    const char* outPath = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if (strcmp(argv[i], "--sim-threads") == 0 || strcmp(argv[i], "--mem-budget") == 0) ++i;
+        else if (!collectSubmissions(argv[i], vb.paths)) { std::cerr << "verify: cannot read " << argv[i] << "\n"; return 1; }
+    }
+    size_t n = vb.paths.size();
+    if (n == 0) { std::cerr << "verify: no submissions\n"; return 1; }
+    auto t0 = std::chrono::steady_clock::now();
+    int threads = simThreads();
+    vb.replays.resize(n);
+    vb.verdicts.assign(n, Verdict());
+    for (int rs = 0; rs < RULES_COUNT; ++rs) vb.loaded[rs] = false;
+    vb.pending.resize(n);
+    for (size_t i = 0; i < n; ++i) vb.pending[i] = i;
+    runVerifyPass(verifyLoadStripe);
+    for (int rs = 0; rs < RULES_COUNT; ++rs) {
+        if (!vb.loaded[rs]) continue;
+        vb.pending.clear();
+        for (size_t i = 0; i < n; ++i)
+            if (!vb.verdicts[i].reason && vb.replays[i].rules == rs) vb.pending.push_back(i);
+        selectRules((RuleSet)rs);
+        runVerifyPass(verifyReplayStripe);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    std::vector<size_t> accepted;
+    for (size_t i = 0; i < n; ++i) {
+        const Verdict &v = vb.verdicts[i];
+        if (v.accepted) { accepted.push_back(i); continue; }
+        std::cout << "REJECT " << vb.paths[i] << ": " << v.reason;
+        if (strcmp(v.reason, "score mismatch") == 0) std::cout << " (claims " << vb.replays[i].finalScore << ", replays to " << v.score << ")";
+        std::cout << "\n";
+    }
+    std::cout << "verify: " << n << " submissions, " << accepted.size() << " accepted, " << n - accepted.size()
+              << " rejected in " << std::fixed << std::setprecision(2) << secs << " s ("
+              << std::setprecision(0) << (secs > 0 ? n * 60.0 / secs : 0.0) << "/min on " << threads << " threads)\n";
+    if (outPath) {
+        std::stable_sort(accepted.begin(), accepted.end(), [&](size_t a, size_t b) {
+            if (vb.replays[a].rules != vb.replays[b].rules) return vb.replays[a].rules < vb.replays[b].rules;
+            return vb.verdicts[a].score > vb.verdicts[b].score;
+        });
+        std::ofstream out(outPath, std::ios::trunc);
+        if (!out) { std::cerr << "verify: cannot write " << outPath << "\n"; return 1; }
+        for (size_t i : accepted)
+            out << RULE_PARAMS[vb.replays[i].rules].name << " " << vb.paths[i] << " " << vb.verdicts[i].score << " " << std::hex << vb.verdicts[i].hash << std::dec << "\n";
+    }
+    return accepted.size() == n ? 0 : 2;
+}
+
+// =======================================================
+// Part 22: Session Analytics
+// Details: Binary gameplay event log (--analytics) and its offline analyzer (--analyze).
+// =======================================================
+
+// One fixed-size record per gameplay event. Positions are playfield pixels;
+// paddle-relative offsets are in thousandths of the paddle's half width.
+struct SessionEvent {
+    uint32_t timeMs;        // Simulated time since logging started
+    uint8_t type, level;    // SessionEventType; level saturates at 255
+    uint16_t id;            // Brick index, perk type or rule set
+    int16_t x, y;
+};
+static_assert(sizeof(SessionEvent) == 12, "session log records are 12 bytes");
+
+struct SessionLogHeader {
+    char magic[4];          // "DXAL"
+    uint16_t version, recordSize;
+};
+
+const uint16_t SESSION_LOG_VERSION = 1;
+const int SESSION_CHUNK = 2048;             // Events per hand-off to the writer
+const uint32_t SESSION_FLUSH_MS = 10000;    // A partial chunk is handed off after this
+
+// Events go into one of two fixed chunks; a full chunk is handed to the
+// writer thread and the other one is filled meanwhile. Logging an event is a
+// store into the chunk, so the frame never waits for the disk. Should the
+// writer still be busy when the next chunk fills, that chunk is dropped and
+// counted rather than stalling the game.
+struct SessionLog {
+    SessionEvent chunks[2][SESSION_CHUNK];
+    int filling = 0;
+    int count = 0;
+    double timeMs = 0.0;
+    uint32_t flushedAt = 0;
+    uint64_t dropped = 0;
+    FILE* file = nullptr;
+    std::thread writer;
+    std::mutex mu;
+    std::condition_variable cv;
+    int ready = -1;         // Events in the chunk waiting for the writer, or -1
+    bool stop = false;
+} sessionLog;
+
+void sessionWriterLoop() {
+    SessionLog &sl = sessionLog;
+    std::unique_lock<std::mutex> lock(sl.mu);
+    for (;;) {
+        sl.cv.wait(lock, [&sl] { return sl.stop || sl.ready >= 0; });
+        if (sl.ready < 0) return;
+        const SessionEvent* chunk = sl.chunks[sl.filling ^ 1];
+        size_t n = (size_t)sl.ready;
+        lock.unlock();
+        fwrite(chunk, sizeof(SessionEvent), n, sl.file);
+        fflush(sl.file);
+        metricAdd(M_DISK_WRITES);
+        lock.lock();
+        sl.ready = -1;
+        sl.cv.notify_all();
+    }
+}
+
+void handOffSessionChunk() {
+    SessionLog &sl = sessionLog;
+    {
+        std::lock_guard<std::mutex> lock(sl.mu);
+        if (sl.ready >= 0) { sl.dropped += sl.count; sl.count = 0; return; }
+        sl.ready = sl.count;
+        sl.filling ^= 1;
+    }
+    sl.count = 0;
+    sl.flushedAt = (uint32_t)sl.timeMs;
+    sl.cv.notify_all();
+}
+
+void stopSessionLog() {
+    SessionLog &sl = sessionLog;
+    if (!sl.writer.joinable()) return;
+    {
+        std::unique_lock<std::mutex> lock(sl.mu);
+        sl.cv.wait(lock, [&sl] { return sl.ready < 0; });
+    }
+    if (sl.count > 0) handOffSessionChunk();
+    {
+        std::lock_guard<std::mutex> lock(sl.mu);
+        sl.stop = true;
+    }
+    sl.cv.notify_all();
+    sl.writer.join();
+    fclose(sl.file);
+    sl.file = nullptr;
+    if (sl.dropped) std::cerr << "analytics: dropped " << sl.dropped << " events\n";
+}
+
+// Appends to 'path', writing the header when the file is new. An existing
+// log from another format version is left alone.
+bool startSessionLog(const char* path) {
+    SessionLog &sl = sessionLog;
+    SessionLogHeader h;
+    memcpy(h.magic, "DXAL", 4);
+    h.version = SESSION_LOG_VERSION;
+    h.recordSize = sizeof(SessionEvent);
+    sl.file = fopen(path, "ab");
+    if (!sl.file) { std::cerr << "analytics: cannot open " << path << "\n"; return false; }
+    if (ftell(sl.file) == 0) {
+        fwrite(&h, sizeof(h), 1, sl.file);
+    } else {
+        SessionLogHeader old;
+        FILE* in = fopen(path, "rb");
+        bool same = in && fread(&old, sizeof(old), 1, in) == 1 && memcmp(&old, &h, sizeof(h)) == 0;
+        if (in) fclose(in);
+        if (!same) {
+            std::cerr << "analytics: " << path << " is not a version " << SESSION_LOG_VERSION << " log\n";
+            fclose(sl.file);
+            sl.file = nullptr;
+            return false;
+        }
+    }
+    sl.writer = std::thread(sessionWriterLoop);
+    atexit(stopSessionLog);
+    return true;
+}
+
+// Rollouts, ghosts, mosaic tiles and replays step other worlds through the
+// same code; only the live game is a player session.
+void logSessionEvent(const World &w, int type, int id, float x, float y) {
+    SessionLog &sl = sessionLog;
+    if (!sl.file || &w != &world) return;
+    SessionEvent &e = sl.chunks[sl.filling][sl.count];
+    e.timeMs = (uint32_t)sl.timeMs;
+    e.type = (uint8_t)type;
+    e.level = (uint8_t)std::min(w.currentLevel, 255);
+    e.id = (uint16_t)id;
+    e.x = (int16_t)std::max(-32768.0f, std::min(32767.0f, x));
+    e.y = (int16_t)std::max(-32768.0f, std::min(32767.0f, y));
+    if (++sl.count == SESSION_CHUNK) handOffSessionChunk();
+}
+
+// Advances the log clock once per live tick, and hands off a quiet session's
+// partial chunk now and then so a crash loses at most SESSION_FLUSH_MS.
+void sessionLogTick(double dt) {
+    SessionLog &sl = sessionLog;
+    if (!sl.file) return;
+    sl.timeMs += dt * 1000.0;
+    if (sl.count > 0 && (uint32_t)sl.timeMs - sl.flushedAt >= SESSION_FLUSH_MS) handOffSessionChunk();
+}
+
+// Offline analysis. Each worker memory-maps one log at a time and folds its
+// events into the stripe's own aggregate; the stripes are summed at the end.
+const int HEAT_COLS = 40, HEAT_ROWS = 30;      // 20 x 20 px cells
+const int PADDLE_BINS = 20;
+const int ANALYZE_LEVELS = 16;                  // Deeper levels share the last row
+
+enum PerkOutcome { PO_SPAWNED, PO_CAUGHT, PO_MISSED, PO_COUNT };
+
+struct SessionAggregate {
+    uint64_t logs, badLogs, events, bytes, games, levels, gameOvers;
+    uint64_t paddle[PADDLE_BINS];
+    uint64_t lost[HEAT_COLS];                   // Balls lost, by column
+    uint64_t kills[HEAT_ROWS][HEAT_COLS];
+    double killSecs[HEAT_ROWS][HEAT_COLS];      // Seconds into the level, summed
+    uint64_t perks[ANALYZE_LEVELS][PERK_TYPES][PO_COUNT];
+
+    void merge(const SessionAggregate &o) {
+        logs += o.logs; badLogs += o.badLogs; events += o.events; bytes += o.bytes;
+        games += o.games; levels += o.levels; gameOvers += o.gameOvers;
+        for (int b = 0; b < PADDLE_BINS; ++b) paddle[b] += o.paddle[b];
+        for (int c = 0; c < HEAT_COLS; ++c) lost[c] += o.lost[c];
+        for (int r = 0; r < HEAT_ROWS; ++r)
+            for (int c = 0; c < HEAT_COLS; ++c) {
+                kills[r][c] += o.kills[r][c];
+                killSecs[r][c] += o.killSecs[r][c];
+            }
+        for (int l = 0; l < ANALYZE_LEVELS; ++l)
+            for (int t = 0; t < PERK_TYPES; ++t)
+                for (int k = 0; k < PO_COUNT; ++k) perks[l][t][k] += o.perks[l][t][k];
+    }
+};
+
+struct AnalyzeBatch {
+    std::vector<std::string> paths;
+    std::atomic<size_t> next;
+    SessionAggregate stripes[MAX_SIM_THREADS];
+} analyzeBatch;
+
+struct MappedFile {
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+void unmapFile(MappedFile &m) {
+    if (m.data) UnmapViewOfFile(m.data);
+    if (m.mapping) CloseHandle(m.mapping);
+    if (m.file != INVALID_HANDLE_VALUE) CloseHandle(m.file);
+    m = MappedFile();
+}
+
+// Read-only view of a whole file. Empty files cannot be mapped and fail.
+bool mapFile(const std::string &path, MappedFile &m) {
+    m.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m.file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m.file, &size) || size.QuadPart == 0) { unmapFile(m); return false; }
+    m.mapping = CreateFileMappingA(m.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m.mapping) m.data = (const uint8_t*)MapViewOfFile(m.mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m.data) { unmapFile(m); return false; }
+    m.size = (size_t)size.QuadPart;
+    return true;
+}
+
+inline int heatCol(int x) { return std::max(0, std::min(HEAT_COLS - 1, x * HEAT_COLS / WIN_W)); }
+inline int heatRow(int y) { return std::max(0, std::min(HEAT_ROWS - 1, (WIN_H - 1 - y) * HEAT_ROWS / WIN_H)); }
+
+// A trailing partial record (a log cut off mid-write) is ignored.
+bool analyzeLog(const uint8_t* data, size_t size, SessionAggregate &a) {
+    SessionLogHeader h;
+    if (size < sizeof(h)) return false;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, "DXAL", 4) != 0 || h.version != SESSION_LOG_VERSION || h.recordSize != sizeof(SessionEvent)) return false;
+    const SessionEvent* ev = (const SessionEvent*)(data + sizeof(h));
+    size_t n = (size - sizeof(h)) / sizeof(SessionEvent);
+    uint32_t levelStart = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const SessionEvent &e = ev[i];
+        int lv = std::max(0, std::min(ANALYZE_LEVELS - 1, e.level - 1));
+        switch (e.type) {
+            case SE_GAME_START: a.games++; a.levels++; levelStart = e.timeMs; break;
+            case SE_LEVEL_START: a.levels++; levelStart = e.timeMs; break;
+            case SE_PADDLE_HIT:
+                a.paddle[std::max(0, std::min(PADDLE_BINS - 1, (e.y + 1000) * PADDLE_BINS / 2000))]++;
+                break;
+            case SE_BRICK_KILL:
+                a.kills[heatRow(e.y)][heatCol(e.x)]++;
+                a.killSecs[heatRow(e.y)][heatCol(e.x)] += (e.timeMs - levelStart) / 1000.0;
+                break;
+            case SE_PERK_SPAWN: if (e.id < PERK_TYPES) a.perks[lv][e.id][PO_SPAWNED]++; break;
+            case SE_PERK_CATCH: if (e.id < PERK_TYPES) a.perks[lv][e.id][PO_CAUGHT]++; break;
+            case SE_PERK_MISS:  if (e.id < PERK_TYPES) a.perks[lv][e.id][PO_MISSED]++; break;
+            case SE_BALL_LOST: a.lost[heatCol(e.x)]++; break;
+            case SE_GAME_OVER: a.gameOvers++; break;
+        }
+    }
+    a.events += n;
+    a.bytes += size;
+    return true;
+}
+
+void analyzeStripe(int stripe) {
+    AnalyzeBatch &ab = analyzeBatch;
+    SessionAggregate &a = ab.stripes[stripe];
+    for (size_t k; (k = ab.next.fetch_add(1)) < ab.paths.size(); ) {
+        MappedFile m;
+        bool ok = mapFile(ab.paths[k], m) && analyzeLog(m.data, m.size, a);
+        unmapFile(m);
+        if (ok) a.logs++;
+        else { a.badLogs++; std::cerr << "analyze: skipping " << ab.paths[k] << "\n"; }
+    }
+}
+
+// 8-bit greyscale PGM, one pixel per heat cell, scaled to the hottest cell.
+bool writeHeatmap(const std::string &path, const double (&v)[HEAT_ROWS][HEAT_COLS]) {
+    double top = 0.0;
+    for (int r = 0; r < HEAT_ROWS; ++r)
+        for (int c = 0; c < HEAT_COLS; ++c) top = std::max(top, v[r][c]);
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out << "P5\n" << HEAT_COLS << " " << HEAT_ROWS << "\n255\n";
+    for (int r = 0; r < HEAT_ROWS; ++r)
+        for (int c = 0; c < HEAT_COLS; ++c) out.put((char)(uint8_t)(top > 0 ? v[r][c] / top * 255.0 + 0.5 : 0));
+    return (bool)out;
+}
+
+bool writeAnalysis(const std::string &prefix, const SessionAggregate &a) {
+    double density[HEAT_ROWS][HEAT_COLS], early[HEAT_ROWS][HEAT_COLS];
+    double slowest = 0.0;
+    for (int r = 0; r < HEAT_ROWS; ++r)
+        for (int c = 0; c < HEAT_COLS; ++c) {
+            density[r][c] = (double)a.kills[r][c];
+            early[r][c] = a.kills[r][c] ? a.killSecs[r][c] / a.kills[r][c] : -1.0;
+            slowest = std::max(slowest, early[r][c]);
+        }
+    // Bright cells die soonest after the level starts; cells never killed stay black.
+    for (int r = 0; r < HEAT_ROWS; ++r)
+        for (int c = 0; c < HEAT_COLS; ++c) early[r][c] = early[r][c] < 0 ? 0.0 : slowest - early[r][c] + 1.0;
+    if (!writeHeatmap(prefix + "-kills.pgm", density) || !writeHeatmap(prefix + "-first.pgm", early)) return false;
+
+    std::ofstream csv((prefix + "-aggregates.csv").c_str(), std::ios::trunc);
+    if (!csv) return false;
+    csv << "section,key,count\n";
+    for (int b = 0; b < PADDLE_BINS; ++b)
+        csv << "paddle_hit," << std::fixed << std::setprecision(2) << -1.0 + (b + 0.5) * 2.0 / PADDLE_BINS << "," << a.paddle[b] << "\n";
+    for (int c = 0; c < HEAT_COLS; ++c) csv << "ball_lost," << c * WIN_W / HEAT_COLS << "," << a.lost[c] << "\n";
+    csv << "level,perk,spawned,caught,missed\n";
+    for (int l = 0; l < ANALYZE_LEVELS; ++l)
+        for (int t = 0; t < PERK_TYPES; ++t) {
+            const uint64_t *p = a.perks[l][t];
+            if (p[PO_SPAWNED] || p[PO_CAUGHT] || p[PO_MISSED])
+                csv << l + 1 << (l == ANALYZE_LEVELS - 1 ? "+" : "") << "," << PERK_NAMES[t] << ","
+                    << p[PO_SPAWNED] << "," << p[PO_CAUGHT] << "," << p[PO_MISSED] << "\n";
+        }
+    return (bool)csv;
+}
+
+int runAnalyzer(int argc, char** argv) {
+    AnalyzeBatch &ab = analyzeBatch;
+    headless = true;
+    const char* outPrefix = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPrefix = argv[++i];
+        else if (strcmp(argv[i], "--sim-threads") == 0 || strcmp(argv[i], "--mem-budget") == 0) ++i;
+        else if (!collectSubmissions(argv[i], ab.paths, ".dxa")) { std::cerr << "analyze: cannot read " << argv[i] << "\n"; return 1; }
+    }
+    if (ab.paths.empty()) { std::cerr << "analyze: no logs\n"; return 1; }
+    auto t0 = std::chrono::steady_clock::now();
+    int threads = simThreads();
+    memset(ab.stripes, 0, sizeof(ab.stripes));
+    ab.next = 0;
+    runStripes(analyzeStripe);
+    SessionAggregate &a = ab.stripes[0];
+    for (int s = 1; s < threads; ++s) a.merge(ab.stripes[s]);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    std::cout << "analyze: " << a.logs << " logs (" << a.badLogs << " unreadable), " << a.events << " events, "
+              << a.games << " games, " << a.levels << " levels in " << std::fixed << std::setprecision(2) << secs
+              << " s (" << std::setprecision(1) << a.bytes / 1e6 / std::max(secs, 1e-6) << " MB/s on " << threads << " threads)\n";
+    uint64_t paddleHits = 0;
+    for (uint64_t v : a.paddle) paddleHits += v;
+    std::cout << "Paddle hits, left edge to right edge:\n";
+    for (int b = 0; b < PADDLE_BINS; ++b) {
+        double pct = paddleHits ? 100.0 * a.paddle[b] / paddleHits : 0.0;
+        std::cout << std::setw(6) << std::setprecision(2) << -1.0 + (b + 0.5) * 2.0 / PADDLE_BINS << " "
+                  << std::setw(5) << std::setprecision(1) << pct << "% " << std::string((size_t)(pct + 0.5), '#') << "\n";
+    }
+    std::cout << "Perk catch rate by level (caught / caught + missed):\n  level";
+    for (int t = 0; t < PERK_TYPES; ++t) std::cout << std::setw(10) << PERK_NAMES[t];
+    std::cout << "\n";
+    for (int l = 0; l < ANALYZE_LEVELS; ++l) {
+        uint64_t seen = 0;
+        for (int t = 0; t < PERK_TYPES; ++t) seen += a.perks[l][t][PO_SPAWNED];
+        if (!seen) continue;
+        std::cout << std::setw(6) << l + 1 << (l == ANALYZE_LEVELS - 1 ? "+" : " ");
+        for (int t = 0; t < PERK_TYPES; ++t) {
+            uint64_t done = a.perks[l][t][PO_CAUGHT] + a.perks[l][t][PO_MISSED];
+            if (done) std::cout << std::setw(9) << std::setprecision(1) << 100.0 * a.perks[l][t][PO_CAUGHT] / done << "%";
+            else std::cout << std::setw(10) << "-";
+        }
+        std::cout << "\n";
+    }
+    if (outPrefix && !writeAnalysis(outPrefix, a)) { std::cerr << "analyze: cannot write " << outPrefix << "-*\n"; return 1; }
+    return a.badLogs ? 2 : 0;
+}
+
+// =======================================================
+// Part 23: Stress Scenarios
+// Details: Entity-heavy worst cases run end to end (--stress).
+// =======================================================
+
+// Each scenario builds a loaded world and holds the load every frame, so
+// the same count is measured throughout. Scenarios run under training rules
+// so a lost ball never ends the run early.
+struct StressScenario {
+    const char* name;
+    int worlds;                  // Independent worlds stepped per frame
+    void (*setup)(World &w);
+    void (*sustain)(World &w);   // Restores the load; not timed
+};
+
+const int STRESS_WARMUP_FRAMES = 60;
+const int STRESS_FRAMES = 600;
+
+// Refills the brick field once it is cleared, keeping the ball in play.
+void holdStressField(World &w) {
+    if (w.bricksRemaining > 0 && w.outcome == WO_NONE) return;
+    generateLevel(w.currentLevel, w.rng.next(), activeRules->perkDropProb, w.bricks, w.bricksRemaining);
+    w.outcome = WO_NONE;
+}
+
+void stressPerksSetup(World &w) {
+    w.perks.reserve(10000 + PERK_CAPACITY);
+}
+
+// Perks that left the screen are replaced above it, within the reserve.
+void stressPerksSustain(World &w) {
+    holdStressField(w);
+    while (w.perks.size() < 10000) {
+        Perk p;
+        p.x = (float)w.rng.range(WIN_W);
+        p.y = (float)(WIN_H + w.rng.range(WIN_H));
+        p.vy = -(80.0f + w.rng.range(120));
+        p.type = w.rng.range(4); // Life, wide, speed, fireball: none end the run
+        p.alive = true;
+        w.perks.push_back(p);
+    }
+}
+
+void stressProjectilesSetup(World &w) {
+    w.projectiles.reserve(50000 + PROJECTILE_CAPACITY);
+}
+
+void stressProjectilesSustain(World &w) {
+    holdStressField(w);
+    while (w.projectiles.size() < 50000) {
+        Projectile p;
+        p.x = (float)w.rng.range(WIN_W);
+        p.y = (float)w.rng.range(WIN_H);
+        p.vy = 500.0f;
+        p.alive = true;
+        w.projectiles.push_back(p);
+    }
+}
+
+void stressNoSetup(World &) {}
+
+// cols x rows bricks packed into the upper half of the screen.
+void buildStressField(World &w, int cols, int rows) {
+    float bw = (float)WIN_W / cols, bh = (WIN_H / 2.0f) / rows;
+    w.bricks.clear();
+    for (int r = 0; r < rows; ++r)
+        for (int c = 0; c < cols; ++c)
+            w.bricks.add(c * bw, WIN_H / 2.0f + r * bh, bw, bh, 1, 0);
+    w.bricks.fitGrid();
+    w.bricksRemaining = cols * rows;
+}
+
+void stressBrickFieldSetup(World &w) { buildStressField(w, 200, 200); }
+
+void stressBrickFieldSustain(World &w) {
+    if (w.bricksRemaining <= 0 || w.outcome != WO_NONE) { stressBrickFieldSetup(w); w.outcome = WO_NONE; }
+}
+
+// Fireball ploughing through the dense field: every brick it touches dies.
+void stressFireballSustain(World &w) {
+    stressBrickFieldSustain(w);
+    w.ball.isFireball = true;
+    w.ball.fireballTimer = 10.0f;
+}
+
+// One world too big for a thread: 200,000 bricks under 20,000 shots, split
+// into stripes across --sim-threads workers. Every fifth brick drops a perk.
+void stressMassiveSetup(World &w) {
+    buildStressField(w, 500, 400);
+    for (int i = 0; i < w.bricks.size(); i += 5) w.bricks.hot[i].type = 1;
+    w.projectiles.reserve(20000 + PROJECTILE_CAPACITY);
+}
+
+void stressMassiveSustain(World &w) {
+    if (w.bricksRemaining <= 0 || w.outcome != WO_NONE) { stressMassiveSetup(w); w.outcome = WO_NONE; }
+    while (w.projectiles.size() < 20000) {
+        Projectile p;
+        p.x = (float)w.rng.range(WIN_W);
+        p.y = (float)w.rng.range(WIN_H / 2);
+        p.vy = 500.0f;
+        p.alive = true;
+        w.projectiles.push_back(p);
+    }
+}
+
+// "balls" approximates 1,000 balls with 1,000 single-ball worlds, since a
+// world holds one ball; only the first one is drawn when windowed.
+const StressScenario STRESS_SCENARIOS[] = {
+    { "perks",       1,    stressPerksSetup,       stressPerksSustain },
+    { "projectiles", 1,    stressProjectilesSetup, stressProjectilesSustain },
+    { "balls",       1000, stressNoSetup,          holdStressField },
+    { "bricks",      1,    stressBrickFieldSetup,  stressBrickFieldSustain },
+    { "fireball",    1,    stressBrickFieldSetup,  stressFireballSustain },
+    { "massive",     1,    stressMassiveSetup,     stressMassiveSustain },
+};
+const int STRESS_SCENARIO_COUNT = sizeof(STRESS_SCENARIOS) / sizeof(STRESS_SCENARIOS[0]);
+
+// World 0 is the global 'world' so the windowed run can render it.
+struct StressRun {
+    std::vector<World> extra;
+    std::vector<double> frameUs;
+    const char* only = nullptr;   // Run just this scenario when set
+    bool windowed = false;
+    int scenario = -1;
+    int frame = 0;
+} stress;
+
+World &stressWorld(int i) { return i == 0 ? world : stress.extra[i - 1]; }
+
+void beginStressScenario(const StressScenario &sc) {
+    stress.extra.assign(sc.worlds - 1, World());
+    stress.frameUs.clear();
+    stress.frameUs.reserve(STRESS_FRAMES);
+    stress.frame = 0;
+    for (int i = 0; i < sc.worlds; ++i) {
+        World &w = stressWorld(i);
+        resetWorld(w, 1000u + i);
+        sc.setup(w);
+        launchBall(w);
+    }
+}
+
+// One frame: hold the load, then step every world (and render if windowed).
+// Returns the cost of the step and render alone, in microseconds.
+double stressFrame(const StressScenario &sc) {
+    const double dt = 1.0 / 60.0;
+    InputFrame in = {};
+    for (int i = 0; i < sc.worlds; ++i) sc.sustain(stressWorld(i));
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < sc.worlds; ++i) {
+        World &w = stressWorld(i);
+        autopilot(w, in);
+        updateGameFn(w, in, dt);
+    }
+    if (stress.windowed) { renderScene(); glFinish(); }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void reportStressScenario(const StressScenario &sc) {
+    double total = 0.0;
+    for (double us : stress.frameUs) total += us;
+    const World &w = world;
+    size_t perks = 0, shots = 0;
+    for (const Perk &p : w.perks) perks += p.alive;
+    for (const Projectile &p : w.projectiles) shots += p.alive;
+    std::cout << std::left << std::setw(13) << sc.name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << (total > 0 ? stress.frameUs.size() * 1e6 / total : 0.0)
+              << std::setw(10) << percentile(stress.frameUs, 0.50)
+              << std::setw(10) << percentile(stress.frameUs, 0.99)
+              << "   worlds " << sc.worlds << ", bricks " << w.bricks.live.size()
+              << ", perks " << perks << ", projectiles " << shots << "\n";
+}
+
+bool nextStressScenario() {
+    while (++stress.scenario < STRESS_SCENARIO_COUNT) {
+        const StressScenario &sc = STRESS_SCENARIOS[stress.scenario];
+        if (stress.only && strcmp(stress.only, sc.name) != 0) continue;
+        beginStressScenario(sc);
+        return true;
+    }
+    return false;
+}
+
+void printStressHeader() {
+    std::cout << "scenario      frames/s    p50 us    p99 us   (" << (stress.windowed ? "windowed" : "headless") << ")\n";
+}
+
+// Windowed runs go through the GLUT loop so the driver's real present path
+// is included; the window is driven as fast as it will go.
+void stressIdle() {
+    const StressScenario &sc = STRESS_SCENARIOS[stress.scenario];
+    double us = stressFrame(sc);
+    if (++stress.frame > STRESS_WARMUP_FRAMES) stress.frameUs.push_back(us);
+    if (stress.frame < STRESS_WARMUP_FRAMES + STRESS_FRAMES) return;
+    reportStressScenario(sc);
+    if (!nextStressScenario()) { printMemReport(std::cout); exit(0); }
+}
+
+int runStress(const char* only, bool windowed, int argc, char** argv) {
+    stress.only = only;
+    stress.windowed = windowed;
+    selectRules(RULES_TRAINING);
+    if (!nextStressScenario()) { std::cerr << "stress: unknown scenario " << only << "\n"; return 1; }
+    printStressHeader();
+
+    if (windowed) {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+        glutInitWindowSize(WIN_W, WIN_H);
+        glutCreateWindow("DX-Ball Stress");
+        glClearColor(0.05f, 0.05f, 0.15f, 1.0f);
+        gameState = GS_PLAYING;
+        glutDisplayFunc(renderScene);
+        glutIdleFunc(stressIdle);
+        glutMainLoop();
+        return 0;
+    }
+
+    headless = true;
+    do {
+        const StressScenario &sc = STRESS_SCENARIOS[stress.scenario];
+        for (int f = 0; f < STRESS_WARMUP_FRAMES; ++f) stressFrame(sc);
+        for (int f = 0; f < STRESS_FRAMES; ++f) stress.frameUs.push_back(stressFrame(sc));
+        reportStressScenario(sc);
+    } while (nextStressScenario());
+    printMemReport(std::cout);
+    return 0;
+}
+
+// =======================================================
+// Part 24: Monte-Carlo Planner
+// Details: MCTS bot over world clones (--plan, --mcts-pilot).
+// =======================================================
+
+// Decisions are taken every PLAN_DECISION_TICKS. An action is where on the
+// paddle to meet the ball (PLAN_AIMS, in half-widths from the centre, which
+// sets the bounce angle) or, with the ball stuck, where to launch from. Each
+// worker grows its own UCT tree from the same root (root parallelism) and
+// the root visit counts are summed. Rollouts play the analytic controller
+// with aim 0 and reseed the copy's rng, so the planner samples perk drops
+// and launch angles rather than reading them off the live generator.
+const float PLAN_AIMS[] = { -0.7f, -0.35f, 0.0f, 0.35f, 0.7f };
+const int PLAN_ACTIONS = sizeof(PLAN_AIMS) / sizeof(PLAN_AIMS[0]);
+const int PLAN_DEFAULT_ACTION = 2;
+const int PLAN_DECISION_TICKS = 30;
+const int PLAN_MAX_DEPTH = 4;          // Decisions below the root
+const int PLAN_ROLLOUT_TICKS = 480;
+const int PLAN_MAX_NODES = 4096;       // Per tree
+const double PLAN_DT = 1.0 / 60.0;
+const double PLAN_EXPLORE = 1.2;
+const double PLAN_LIFE_VALUE = 1000.0, PLAN_CLEAR_VALUE = 1000.0;
+
+// Where the ball's centre will cross the line at paddle top + radius, with
+// the side walls reflecting it and the bricks ignored.
+float predictLandingX(const Ball &b, float paddleTop) {
+    float y = paddleTop + b.radius;
+    if (fabsf(b.vy) < 1e-3f) return b.x;
+    float top = WIN_H - b.radius;
+    float dy = b.vy < 0 ? b.y - y : (top - b.y) + (top - y);
+    float x = b.x + b.vx * (dy / fabsf(b.vy));
+    float lo = b.radius, span = WIN_W - 2.0f * b.radius;
+    float u = fmodf(x - lo, 2.0f * span);
+    if (u < 0) u += 2.0f * span;
+    return lo + (u > span ? 2.0f * span - u : u);
+}
+
+// Analytic paddle controller: steers so the ball lands 'aim' half-widths
+// from the paddle centre; a stuck ball is carried to its launch point first.
+void aimPaddle(const World &w, float aim, InputFrame &in) {
+    const Ball &b = w.ball;
+    const Paddle &p = w.paddle;
+    float target = b.stuck ? WIN_W * (0.5f + aim * 0.5f) : predictLandingX(b, p.y + p.h) - aim * p.w * 0.5f;
+    float centre = p.x + p.w * 0.5f, dead = p.speed * (float)PLAN_DT;
+    in.left = target < centre - dead;
+    in.right = target > centre + dead;
+    in.launch = b.stuck && !in.left && !in.right;
+    in.fire = in.mouseMoved = false;
+}
+
+struct PlanNode {
+    int child[PLAN_ACTIONS];
+    int visits;
+    double total;
+};
+
+struct PlanTree {
+    std::vector<PlanNode> nodes;   // Reserved once, cleared per decision
+    World scratch;                 // Copy-assigned from the root; reuses its storage
+    Rng rng;
+    int rollouts = 0;
+};
+
+struct Planner {
+    bool live = false;             // --mcts-pilot: drives the live game
+    double budgetMs = 8.0;         // Per decision
+    int iterations = 0;            // Per tree instead of a time budget (reproducible)
+    int action = PLAN_DEFAULT_ACTION, ticksLeft = 0;
+    PlanTree trees[MAX_SIM_THREADS];
+    const World *root = nullptr;
+    std::chrono::steady_clock::time_point deadline;
+    uint32_t decision = 0;
+    int lastRollouts = 0;
+} planner;
+
+// Holds one action for a decision's worth of ticks; false once the copy's
+// game has ended.
+bool playPlanAction(World &w, int action) {
+    InputFrame in = {};
+    for (int t = 0; t < PLAN_DECISION_TICKS && w.outcome == WO_NONE; ++t) {
+        aimPaddle(w, PLAN_AIMS[action], in);
+        updateGameFn(w, in, PLAN_DT);
+    }
+    return w.outcome == WO_NONE;
+}
+
+double planValue(const World &w, const World &root) {
+    double v = w.score - root.score - (root.lives - w.lives) * PLAN_LIFE_VALUE;
+    if (w.outcome == WO_LEVEL_CLEAR) v += PLAN_CLEAR_VALUE;
+    return v / PLAN_CLEAR_VALUE;
+}
+
+int newPlanNode(PlanTree &t) {
+    PlanNode n;
+    for (int a = 0; a < PLAN_ACTIONS; ++a) n.child[a] = -1;
+    n.visits = 0; n.total = 0.0;
+    t.nodes.push_back(n);
+    return (int)t.nodes.size() - 1;
+}
+
+void planIteration(PlanTree &t, const World &root) {
+    int path[PLAN_MAX_DEPTH + 1];
+    int depth = 0, node = 0;
+    path[depth++] = node;
+    t.scratch = root;
+    t.scratch.rng = Rng(t.rng.next());
+    bool alive = true;
+    while (alive && depth <= PLAN_MAX_DEPTH) {
+        PlanNode &n = t.nodes[node];
+        int unexpanded = 0, pick = -1;
+        for (int a = 0; a < PLAN_ACTIONS; ++a)
+            if (n.child[a] < 0 && t.rng.range(++unexpanded) == 0) pick = a;
+        if (pick >= 0 && t.nodes.size() < (size_t)PLAN_MAX_NODES) {
+            int c = newPlanNode(t);
+            t.nodes[node].child[pick] = c;
+            alive = playPlanAction(t.scratch, pick);
+            path[depth++] = node = c;
+            break;
+        }
+        double best = -1e30, logN = log((double)n.visits + 1.0);
+        pick = -1;
+        for (int a = 0; a < PLAN_ACTIONS; ++a) {
+            if (n.child[a] < 0) continue;
+            const PlanNode &c = t.nodes[n.child[a]];
+            double u = c.total / c.visits + PLAN_EXPLORE * sqrt(logN / c.visits);
+            if (u > best) { best = u; pick = a; }
+        }
+        if (pick < 0) break;
+        node = n.child[pick];
+        alive = playPlanAction(t.scratch, pick);
+        path[depth++] = node;
+    }
+    InputFrame in = {};
+    for (int k = 0; k < PLAN_ROLLOUT_TICKS && t.scratch.outcome == WO_NONE; ++k) {
+        aimPaddle(t.scratch, 0.0f, in);
+        updateGameFn(t.scratch, in, PLAN_DT);
+    }
+    double v = planValue(t.scratch, root);
+    for (int d = 0; d < depth; ++d) { t.nodes[path[d]].visits++; t.nodes[path[d]].total += v; }
+    t.rollouts++;
+}
+
+void planTreeJob(int stripe) {
+    Planner &pl = planner;
+    PlanTree &t = pl.trees[stripe];
+    quietSim = true;
+    if (t.nodes.capacity() < (size_t)PLAN_MAX_NODES) t.nodes.reserve(PLAN_MAX_NODES);
+    t.nodes.clear();
+    t.rng = Rng(pl.decision * 0x9E3779B9u + stripe * 7919u + 1);
+    t.rollouts = 0;
+    newPlanNode(t);
+    if (pl.iterations > 0) {
+        for (int i = 0; i < pl.iterations; ++i) planIteration(t, *pl.root);
+    } else {
+        do planIteration(t, *pl.root);
+        while (std::chrono::steady_clock::now() < pl.deadline);
+    }
+    quietSim = false;
+}
+
+// Runs every worker's tree against 'w' and returns the most visited action.
+int planDecision(const World &w) {
+    Planner &pl = planner;
+    pl.root = &w;
+    pl.deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((int64_t)(pl.budgetMs * 1000.0));
+    int trees = simThreads();
+    if (trees > 1) runStripes(planTreeJob);
+    else planTreeJob(0);
+    pl.decision++;
+    int visits[PLAN_ACTIONS] = {};
+    pl.lastRollouts = 0;
+    for (int s = 0; s < trees; ++s) {
+        const PlanTree &t = pl.trees[s];
+        pl.lastRollouts += t.rollouts;
+        for (int a = 0; a < PLAN_ACTIONS; ++a)
+            if (t.nodes[0].child[a] >= 0) visits[a] += t.nodes[t.nodes[0].child[a]].visits;
+    }
+    int best = PLAN_DEFAULT_ACTION;
+    for (int a = 0; a < PLAN_ACTIONS; ++a)
+        if (visits[a] > visits[best]) best = a;
+    return best;
+}
+
+// Bot input for one tick: re-plans when the held action runs out.
+void plannerStep(const World &w, InputFrame &in) {
+    Planner &pl = planner;
+    if (pl.ticksLeft <= 0) {
+        pl.action = planDecision(w);
+        pl.ticksLeft = PLAN_DECISION_TICKS;
+    }
+    pl.ticksLeft--;
+    aimPaddle(w, PLAN_AIMS[pl.action], in);
+}
+
+void plannerInput(const World &w, InputFrame &in) {
+    if (planner.live) plannerStep(w, in);
+}
+
+struct PlanRun {
+    int score, level, ticks;
+    bool finished;
+};
+
+// Plays a classic game from 'seed' for up to 'ticks' with the planner (or
+// the analytic controller alone), advancing through cleared levels.
+PlanRun playPlanGame(uint32_t seed, int ticks, bool usePlanner) {
+    World w;
+    resetWorld(w, seed);
+    beginLevel(w, 1);
+    planner.ticksLeft = 0;
+    planner.decision = 0;
+    InputFrame in = {};
+    PlanRun run = { 0, 1, 0, false };
+    for (; run.ticks < ticks; ++run.ticks) {
+        if (usePlanner) plannerStep(w, in);
+        else aimPaddle(w, 0.0f, in);
+        updateGameFn(w, in, PLAN_DT);
+        if (w.outcome == WO_LEVEL_CLEAR) { beginLevel(w, w.currentLevel + 1); planner.ticksLeft = 0; }
+        else if (w.outcome == WO_GAME_OVER) { run.finished = true; break; }
+    }
+    run.score = w.score;
+    run.level = w.currentLevel;
+    return run;
+}
+
+// --plan seed [ticks]: level validation run, planner against the analytic
+// controller on the same seed. --plan-ms and --plan-iters pick the budget.
+int runPlanner(uint32_t seed, int ticks) {
+    selectRules(RULES_CLASSIC);
+    headless = true;
+    auto t0 = std::chrono::steady_clock::now();
+    PlanRun base = playPlanGame(seed, ticks, false);
+    auto t1 = std::chrono::steady_clock::now();
+    PlanRun mcts = playPlanGame(seed, ticks, true);
+    auto t2 = std::chrono::steady_clock::now();
+    std::cout << "plan: seed " << seed << ", " << simThreads() << " trees, "
+              << (planner.iterations > 0 ? planner.iterations : 0) << " iterations/tree, "
+              << planner.budgetMs << " ms budget\n";
+    const PlanRun runs[2] = { base, mcts };
+    const char* names[2] = { "analytic", "mcts" };
+    const double secs[2] = { std::chrono::duration<double>(t1 - t0).count(), std::chrono::duration<double>(t2 - t1).count() };
+    for (int i = 0; i < 2; ++i)
+        std::cout << std::left << std::setw(10) << names[i] << std::right << " score " << std::setw(6) << runs[i].score
+                  << "  level " << std::setw(3) << runs[i].level << "  ticks " << std::setw(6) << runs[i].ticks
+                  << (runs[i].finished ? "  game over" : "") << "  (" << std::fixed << std::setprecision(1) << secs[i] << " s)\n";
+    std::cout << "mcts: " << planner.decision << " decisions, " << planner.lastRollouts << " rollouts in the last decision\n";
+    return 0;
+}
+
+// =======================================================
+// Part 25: Mosaic View
+// Details: A grid of independent games in one window (--mosaic).
+// =======================================================
+
+// Each tile is a World playing a replay (restarting when it ends) or a bot
+// running the planner's analytic controller with its own aim. Tiles are
+// stepped on the --sim-threads workers, tile i on stripe i % threads, with
+// quietSim set; all tiles share the process-wide rule set. The shape renderer
+// draws every tile in one instanced batch, mapping each world into its tile
+// with a TileXform. Without GL 3.3, each tile is drawn through a viewport.
+const int MOSAIC_MIN = 16, MOSAIC_MAX = 64;
+const int MOSAIC_STAGGER = 240;
+
+struct MosaicTile {
+    World w;
+    const Replay *replay = nullptr;
+    size_t cursor = 0;
+    float aim = 0.0f;
+    uint32_t seed = 0;
+    int ticks = 0;
+    TileXform xf;
+    int vx, vy, vw, vh;          // Viewport for the fixed-function fallback
+};
+
+struct Mosaic {
+    std::vector<MosaicTile> tiles;
+    std::vector<Replay> replays;
+    int cols = 0, rows = 0;
+    double simMs = 0.0, renderMs = 0.0;   // Smoothed per frame
+    int lastFrame = 0;
+} mosaic;
+
+void restartMosaicTile(MosaicTile &t) {
+    t.seed = t.replay ? t.replay->seed : t.seed * 1664525u + 1013904223u;
+    resetWorld(t.w, t.seed);
+    t.cursor = 0;
+    t.ticks = 0;
+}
+
+void stepMosaicTile(MosaicTile &t) {
+    if (t.replay) {
+        const auto &recs = t.replay->records;
+        for (; t.cursor < recs.size() && recs[t.cursor].kind != RR_TICK; ++t.cursor)
+            beginLevel(t.w, recs[t.cursor].kind == RR_NEXT_LEVEL ? t.w.currentLevel + 1 : t.w.currentLevel);
+        if (t.cursor == recs.size()) { restartMosaicTile(t); return; }
+        const ReplayRecord &rec = recs[t.cursor++];
+        updateGameFn(t.w, replayInput(rec), rec.dtMs / 1000.0);
+        return;
+    }
+    if (t.w.outcome == WO_LEVEL_CLEAR) beginLevel(t.w, t.w.currentLevel + 1);
+    else if (t.w.outcome == WO_GAME_OVER) restartMosaicTile(t);
+    InputFrame in = {};
+    aimPaddle(t.w, t.aim, in);
+    in.fire = ++t.ticks % 20 == 0;
+    updateGameFn(t.w, in, PLAN_DT);
+}
+
+void mosaicStripe(int stripe) {
+    Mosaic &m = mosaic;
+    quietSim = true;
+    for (size_t i = stripe; i < m.tiles.size(); i += simWorkers.threads) stepMosaicTile(m.tiles[i]);
+    quietSim = false;
+}
+
+// Fits WIN_W x WIN_H playfields into a cols x rows grid, keeping the aspect.
+void layoutMosaic() {
+    Mosaic &m = mosaic;
+    int n = (int)m.tiles.size();
+    m.cols = (int)ceil(sqrt((double)n));
+    m.rows = (n + m.cols - 1) / m.cols;
+    float tw = (float)WIN_W / m.cols, th = (float)WIN_H / m.rows;
+    float scale = std::min(tw / WIN_W, th / WIN_H) * 0.96f;
+    int ww = glutGet(GLUT_WINDOW_WIDTH), wh = glutGet(GLUT_WINDOW_HEIGHT);
+    for (int i = 0; i < n; ++i) {
+        MosaicTile &t = m.tiles[i];
+        int c = i % m.cols, r = i / m.cols;
+        t.xf.scale = scale;
+        t.xf.ox = c * tw + (tw - WIN_W * scale) * 0.5f;
+        t.xf.oy = WIN_H - (r + 1) * th + (th - WIN_H * scale) * 0.5f;
+        t.vx = (int)(t.xf.ox * ww / WIN_W); t.vy = (int)(t.xf.oy * wh / WIN_H);
+        t.vw = (int)(WIN_W * scale * ww / WIN_W); t.vh = (int)(WIN_H * scale * wh / WIN_H);
+    }
+}
+
+void renderMosaic() {
+    Mosaic &m = mosaic;
+    auto t0 = std::chrono::steady_clock::now();
+    frameArena.reset();
+    glClear(GL_COLOR_BUFFER_BIT);
+    glMatrixMode(GL_PROJECTION); glLoadIdentity();
+    glOrtho(0, WIN_W, 0, WIN_H, -1, 1);
+    glMatrixMode(GL_MODELVIEW); glLoadIdentity();
+    if (initShapeRenderer()) {
+        shapes.batch.clear();
+        for (const MosaicTile &t : m.tiles) queueWorldShapes(t.w, t.xf);
+        flushShapes();
+    } else {
+        for (const MosaicTile &t : m.tiles) {
+            glViewport(t.vx, t.vy, t.vw, t.vh);
+            renderPlayfield(t.w, false);
+        }
+        glViewport(0, 0, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+    }
+    glColor3f(0.3f, 0.3f, 0.45f);
+    for (const MosaicTile &t : m.tiles) {
+        float w = WIN_W * t.xf.scale, h = WIN_H * t.xf.scale;
+        glBegin(GL_LINE_LOOP);
+        glVertex2f(t.xf.ox, t.xf.oy); glVertex2f(t.xf.ox + w, t.xf.oy);
+        glVertex2f(t.xf.ox + w, t.xf.oy + h); glVertex2f(t.xf.ox, t.xf.oy + h);
+        glEnd();
+    }
+    glColor3f(1, 1, 1);
+    for (const MosaicTile &t : m.tiles)
+        drawText(t.xf.ox + 3, t.xf.oy + WIN_H * t.xf.scale - 12, frameText("L%d %d", t.w.currentLevel, t.w.score), GLUT_BITMAP_HELVETICA_10);
+    drawText(4, 4, frameText("%d games  sim %.2f ms  render %.2f ms", (int)m.tiles.size(), m.simMs, m.renderMs), GLUT_BITMAP_HELVETICA_10);
+    glutSwapBuffers();
+    m.renderMs += (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() - m.renderMs) * 0.1;
+}
+
+// Fixed 60 Hz: the next frame is scheduled for 16 ms after this one began.
+void mosaicTimer(int) {
+    Mosaic &m = mosaic;
+    m.lastFrame = glutGet(GLUT_ELAPSED_TIME);
+    auto t0 = std::chrono::steady_clock::now();
+    runStripes(mosaicStripe);
+    m.simMs += (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() - m.simMs) * 0.1;
+    glutPostRedisplay();
+    glutTimerFunc(std::max(0, 16 - (glutGet(GLUT_ELAPSED_TIME) - m.lastFrame)), mosaicTimer, 0);
+}
+
+void mosaicReshape(int w, int h) {
+    glViewport(0, 0, w, h);
+    layoutMosaic();
+}
+
+void mosaicKey(unsigned char key, int, int) {
+    if (key != 27) return;
+    std::cout << "mosaic: " << mosaic.tiles.size() << " games, sim " << std::fixed << std::setprecision(2)
+              << mosaic.simMs << " ms, render " << mosaic.renderMs << " ms per frame\n";
+    exit(0);
+}
+
+// --mosaic [games] [replay.dxr|list.txt]...: replays fill the tiles in turn;
+// with none given, every tile is a bot.
+int runMosaic(int argc, char** argv) {
+    Mosaic &m = mosaic;
+    int games = MOSAIC_MIN;
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--sim-threads") == 0 || strcmp(argv[i], "--mem-budget") == 0) ++i;
+        else if (isdigit((unsigned char)argv[i][0])) games = std::max(MOSAIC_MIN, std::min(MOSAIC_MAX, atoi(argv[i])));
+        else if (!collectSubmissions(argv[i], paths)) { std::cerr << "mosaic: cannot read " << argv[i] << "\n"; return 1; }
+    }
+    for (const std::string &p : paths) {
+        Replay r;
+        if (!loadReplay(p, r)) { std::cerr << "mosaic: cannot load " << p << "\n"; continue; }
+        if (!m.replays.empty() && r.rules != m.replays[0].rules) { std::cerr << "mosaic: " << p << " uses other rules, skipped\n"; continue; }
+        m.replays.push_back(r);
+    }
+    selectRules(m.replays.empty() ? RULES_CLASSIC : (RuleSet)m.replays[0].rules);
+    m.tiles.resize(games);
+    for (int i = 0; i < games; ++i) {
+        MosaicTile &t = m.tiles[i];
+        if (!m.replays.empty()) t.replay = &m.replays[i % m.replays.size()];
+        t.aim = PLAN_AIMS[i % PLAN_ACTIONS];
+        t.seed = 2000u + i;
+        restartMosaicTile(t);
+        // Tiles sharing a replay start MOSAIC_STAGGER ticks apart.
+        if (t.replay) for (int k = 0; k < (i / (int)m.replays.size()) * MOSAIC_STAGGER; ++k) stepMosaicTile(t);
+    }
+    simThreads();
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(WIN_W, WIN_H);
+    glutCreateWindow("DX-Ball Mosaic");
+    glClearColor(0.05f, 0.05f, 0.15f, 1.0f);
+    layoutMosaic();
+    glutDisplayFunc(renderMosaic);
+    glutReshapeFunc(mosaicReshape);
+    glutKeyboardFunc(mosaicKey);
+    glutTimerFunc(0, mosaicTimer, 0);
+    glutMainLoop();
+    return 0;
+}
+
+// =======================================================
+// Part 26: Save & Resume
+// Details: Versioned savegame written off the game thread; restored at startup.
+// =======================================================
+
+// Layout: "DXSV", u32 SAVE_VERSION, u8 rule set, u8 screen, f32 elapsed
+// time, u32 image size, serializeWorld image, u32 FNV-1a of everything
+// before it. Bump SAVE_VERSION whenever serializeWorld's layout changes.
+const char* SAVE_PATH = "savegame.dxs";
+const uint32_t SAVE_VERSION = 1;
+const float AUTOSAVE_SECONDS = 5.0f;
+bool freshStart = false;     // --fresh: ignore the savegame at startup
+
+typedef TaggedVec<uint8_t, MEM_SAVES> SaveBytes;
+
+enum SaveJob { SJ_NONE, SJ_WRITE, SJ_DISCARD };
+
+// The game thread only copies a world image into 'pending'; framing, the
+// write, the flush and the rename happen on the writer thread. A newer
+// request replaces one the writer has not picked up yet.
+struct SaveWriter {
+    std::thread writer;
+    std::mutex mu;
+    std::condition_variable cv;
+    SaveJob job = SJ_NONE;
+    SaveBytes pending, file;
+    uint8_t rules = 0, screen = 0;
+    float elapsed = 0.0f;
+    float sinceAutosave = 0.0f;
+    bool stop = false;
+} saves;
+
+uint32_t fnv1a32(const uint8_t* p, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+// Write and flush the temp file to disk, then rename it with write-through,
+// so a power cut leaves either the previous save or the new one, never a
+// torn file. The rename alone does not flush the temp file's data.
+void writeSaveFile(const SaveBytes &bytes) {
+    std::string tmp = std::string(SAVE_PATH) + ".tmp";
+    HANDLE f = CreateFileA(tmp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) return;
+    DWORD wrote = 0;
+    bool ok = WriteFile(f, bytes.data(), (DWORD)bytes.size(), &wrote, NULL) && wrote == bytes.size() && FlushFileBuffers(f);
+    CloseHandle(f);
+    if (!ok) { DeleteFileA(tmp.c_str()); return; }
+    if (MoveFileExA(tmp.c_str(), SAVE_PATH, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        metricAdd(M_DISK_WRITES);
+}
+
+void saveWriterLoop() {
+    SaveWriter &sw = saves;
+    std::unique_lock<std::mutex> lock(sw.mu);
+    for (;;) {
+        sw.cv.wait(lock, [&sw] { return sw.stop || sw.job != SJ_NONE; });
+        SaveJob job = sw.job;
+        if (job == SJ_NONE) return;
+        sw.job = SJ_NONE;
+        SaveBytes &f = sw.file;
+        if (job == SJ_WRITE) {
+            f.clear();
+            f.insert(f.end(), { 'D', 'X', 'S', 'V' });
+            putPod(f, SAVE_VERSION); putPod(f, sw.rules); putPod(f, sw.screen); putPod(f, sw.elapsed);
+            putPod(f, (uint32_t)sw.pending.size());
+            f.insert(f.end(), sw.pending.begin(), sw.pending.end());
+        }
+        lock.unlock();
+        if (job == SJ_WRITE) {
+            putPod(f, fnv1a32(f.data(), f.size()));
+            writeSaveFile(f);
+        } else {
+            DeleteFileA(SAVE_PATH);
+        }
+        lock.lock();
+    }
+}
+
+// Only screens with a game in progress are worth resuming.
+bool gameInProgress() {
+    return gameState == GS_PLAYING || gameState == GS_PAUSED || gameState == GS_LEVEL_CLEAR;
+}
+
+template <typename Image> void queueSave(const Image &image) {
+    SaveWriter &sw = saves;
+    if (!sw.writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(sw.mu);
+        sw.pending.assign(image.begin(), image.end());
+        sw.rules = (uint8_t)activeRuleSet;
+        sw.screen = (uint8_t)(world.outcome == WO_LEVEL_CLEAR ? GS_LEVEL_CLEAR : GS_PAUSED);
+        sw.elapsed = (float)elapsedTime;
+        sw.job = SJ_WRITE;
+    }
+    sw.cv.notify_one();
+    sw.sinceAutosave = 0.0f;
+}
+
+// On pause and when leaving a game for the menu.
+void saveGameAsync() {
+    static SaveBytes image;
+    if (image.capacity() == 0) image.reserve(TT_KEYFRAME_RESERVE);
+    serializeWorld(world, image);
+    queueSave(image);
+}
+
+// Called after each tick's rewind capture, which has just serialized the
+// live world; the autosave copies that image instead of making its own.
+void autosaveTick(double dt) {
+    SaveWriter &sw = saves;
+    if (!sw.writer.joinable()) return;
+    sw.sinceAutosave += (float)dt;
+    if (sw.sinceAutosave >= AUTOSAVE_SECONDS && timeTravel.cursor == 0) queueSave(timeTravel.prevImage);
+}
+
+// A finished game has nothing to resume.
+void discardSavedGame() {
+    SaveWriter &sw = saves;
+    if (!sw.writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(sw.mu);
+        sw.job = SJ_DISCARD;
+    }
+    sw.cv.notify_one();
+}
+
+void stopSaveWriter() {
+    SaveWriter &sw = saves;
+    if (gameInProgress()) saveGameAsync();
+    {
+        std::lock_guard<std::mutex> lock(sw.mu);
+        sw.stop = true;
+    }
+    sw.cv.notify_one();
+    if (sw.writer.joinable()) sw.writer.join();
+}
+
+void startSaveWriter() {
+    saves.pending.reserve(TT_KEYFRAME_RESERVE);
+    saves.file.reserve(TT_KEYFRAME_RESERVE + 64);
+    saves.writer = std::thread(saveWriterLoop);
+    atexit(stopSaveWriter);
+}
+
+// Puts a saved game back into 'world', paused (or on its level-clear
+// screen). A missing, foreign or damaged save is ignored.
+bool restoreSavedGame() {
+    std::ifstream ifs(SAVE_PATH, std::ios::binary);
+    if (!ifs) return false;
+    SaveBytes data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    auto t0 = std::chrono::steady_clock::now();
+    ByteReader r(data.data(), data.size());
+    char magic[4]; uint32_t version = 0, imageSize = 0, sum = 0;
+    uint8_t rules = 0, screen = 0;
+    float elapsed = 0.0f;
+    r.bytes(magic, 4); r.pod(version); r.pod(rules); r.pod(screen); r.pod(elapsed); r.pod(imageSize);
+    const uint8_t* image = r.p;
+    bool ok = r.ok && memcmp(magic, "DXSV", 4) == 0 && version == SAVE_VERSION && rules < RULES_COUNT
+           && (screen == GS_PAUSED || screen == GS_LEVEL_CLEAR) && (size_t)(r.end - r.p) == imageSize + sizeof(sum);
+    if (ok) {
+        memcpy(&sum, image + imageSize, sizeof(sum));
+        ok = sum == fnv1a32(data.data(), data.size() - sizeof(sum));
+    }
+    World restored;
+    if (!ok || !deserializeWorld(restored, image, imageSize)) {
+        std::cerr << "savegame: ignoring unreadable " << SAVE_PATH << "\n";
+        return false;
+    }
+    selectRules((RuleSet)rules);
+    restored.perks.reserve(PERK_CAPACITY);
+    restored.projectiles.reserve(PROJECTILE_CAPACITY);
+    std::swap(world, restored);
+    syncScriptMusic(world);
+    resetTimeTravel();
+    elapsedTime = elapsed;
+    gameState = (GameState)screen;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "savegame: resumed level " << world.currentLevel << " with " << world.score << " points in "
+              << std::fixed << std::setprecision(0) << us << " us\n";
+    return true;
+}
+
+// =======================================================
+// Part 27: Main Entry
+// Details: GLUT initialization, setting callbacks, and starting the main loop.
+// =======================================================
+
+int main(int argc, char** argv) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--mem-budget") == 0 && !parseMemBudgets(argv[i + 1])) return 1;
+        if (strcmp(argv[i], "--sim-threads") == 0) simWorkers.threads = std::max(1, atoi(argv[i + 1]));
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) return runBenchmark();
+    if (argc > 1 && strcmp(argv[1], "--spectate") == 0) return runSpectator(argc, argv, argc > 2 ? argv[2] : SPECTATOR_SOCKET);
+    if (argc > 1 && strcmp(argv[1], "--telemetry-read") == 0) return runTelemetryReader(argc > 2 ? atoi(argv[2]) : 1000);
+    if (argc > 4 && strcmp(argv[1], "--record-bot") == 0)
+        return recordBotReplay(argv[2], (uint32_t)strtoul(argv[3], NULL, 10), atoi(argv[4]), argc > 5 ? atoi(argv[5]) : 6000);
+    if (argc > 2 && strcmp(argv[1], "--plan") == 0) {
+        for (int i = 3; i + 1 < argc; ++i) {
+            if (strcmp(argv[i], "--plan-ms") == 0) planner.budgetMs = atof(argv[++i]);
+            else if (strcmp(argv[i], "--plan-iters") == 0) planner.iterations = atoi(argv[++i]);
+        }
+        return runPlanner((uint32_t)strtoul(argv[2], NULL, 10), argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 36000);
+    }
+    if (argc > 2 && strcmp(argv[1], "--verify") == 0) return runVerifier(argc, argv);
+    if (argc > 2 && strcmp(argv[1], "--analyze") == 0) return runAnalyzer(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--mosaic") == 0) return runMosaic(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--alloc-check") == 0) {
+        int ticks = 20000;
+        bool windowed = false;
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], "--windowed") == 0) windowed = true;
+            else ticks = atoi(argv[i]);
+        }
+        return runAllocCheck(ticks, windowed, argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--stress") == 0) {
+        const char* only = nullptr;
+        bool windowed = false;
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], "--windowed") == 0) windowed = true;
+            else if (strcmp(argv[i], "--mem-budget") == 0 || strcmp(argv[i], "--sim-threads") == 0) ++i;
+            else only = argv[i];
+        }
+        return runStress(only, windowed, argc, argv);
+    }
+    if (argc > 2 && strcmp(argv[1], "--regress") == 0) {
+        bool writeBaseline = false;
+        double threshold = 0.15;
+        for (int i = 3; i < argc; ++i) {
+            if (strcmp(argv[i], "--write-baseline") == 0) writeBaseline = true;
+            else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        }
+        return runRegression(argv[2], writeBaseline, threshold);
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--publish") == 0) startSpectatorServer(i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : SPECTATOR_SOCKET);
+        else if (strcmp(argv[i], "--telemetry") == 0) startTelemetry();
+        else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) startMetricsExporter(argv[++i]);
+        else if (strcmp(argv[i], "--hitch-ms") == 0 && i + 1 < argc) flight.budgetMs = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--perf") == 0) { initPerfCounters(); atexit(printPerfReportAtExit); }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) liveRecording.path = argv[++i];
+        else if (strcmp(argv[i], "--ghost") == 0 && i + 1 < argc) loadGhost(argv[++i]);
+        else if (strcmp(argv[i], "--analytics") == 0 && i + 1 < argc) startSessionLog(argv[++i]);
+        else if (strcmp(argv[i], "--legacy-gl") == 0) legacyGl = true;
+        else if (strcmp(argv[i], "--fresh") == 0) freshStart = true;
+        else if (strcmp(argv[i], "--mcts-pilot") == 0) {
+            planner.live = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') planner.budgetMs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            quality.level = std::max(0, std::min(QUALITY_COUNT - 1, atoi(argv[++i])));
+            quality.pinned = true;
+        }
+    }
+    startFlightRecorder(flight.budgetMs);
+    startSaveWriter();
+
     srand((unsigned)time(NULL));
     highScore = loadHighScore();
+    probeMusic();
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
@@ -683,8 +5270,9 @@ int main(int argc, char** argv) {
     // Set a solid dark blue background color
     glClearColor(0.05f, 0.05f, 0.15f, 1.0f);
 
-    resetPaddleAndBall();
-    createBricksForLevel(currentLevel);
+    resetWorld(world, (uint32_t)rand());
+    if (!freshStart) restoreSavedGame();
+    resyncTelemetryLives();
 
     glutDisplayFunc(renderScene);
     glutMouseFunc(mouseClick);
@@ -694,7 +5282,7 @@ int main(int argc, char** argv) {
     glutKeyboardUpFunc(keyboardUp);
     glutSpecialFunc(specialDown);
     glutSpecialUpFunc(specialUp);
-    glutTimerFunc(16, timerFunc, 0);
+    wakeFrameLoop();
 
     glutMainLoop();
     return 0;